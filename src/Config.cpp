@@ -27,6 +27,7 @@ along with this program; If not, see <https://www.gnu.org/licenses/>
 #define PARAM_MAIN_OUTPUT_NAME "MainOutputName"
 #define PARAM_PREVIEW_OUTPUT_ENABLED "PreviewOutputEnabled"
 #define PARAM_PREVIEW_OUTPUT_NAME "PreviewOutputName"
+#define PARAM_PREVIEW_READBACK_DEPTH "PreviewReadbackDepth"
 
 Config* Config::_instance = nullptr;
 
@@ -34,7 +35,8 @@ Config::Config() :
 	OutputEnabled(false),
 	OutputName("OBS"),
 	PreviewOutputEnabled(false),
-	PreviewOutputName("OBS Preview")
+	PreviewOutputName("OBS Preview"),
+	PreviewReadbackDepth(1)
 {
 	config_t* obs_config = obs_frontend_get_global_config();
 	if (obs_config) {
@@ -47,6 +49,8 @@ Config::Config() :
 			SECTION_NAME, PARAM_PREVIEW_OUTPUT_ENABLED, PreviewOutputEnabled);
 		config_set_default_string(obs_config,
 			SECTION_NAME, PARAM_PREVIEW_OUTPUT_NAME, PreviewOutputName.toUtf8().constData());
+		config_set_default_int(obs_config,
+			SECTION_NAME, PARAM_PREVIEW_READBACK_DEPTH, PreviewReadbackDepth);
 	}
 }
 
@@ -62,6 +66,8 @@ void Config::Load() {
 			SECTION_NAME, PARAM_PREVIEW_OUTPUT_ENABLED);
 		PreviewOutputName = config_get_string(obs_config,
 			SECTION_NAME, PARAM_PREVIEW_OUTPUT_NAME);
+		PreviewReadbackDepth = (uint32_t)config_get_int(obs_config,
+			SECTION_NAME, PARAM_PREVIEW_READBACK_DEPTH);
 	}
 }
 
@@ -77,6 +83,8 @@ void Config::Save() {
 			SECTION_NAME, PARAM_PREVIEW_OUTPUT_ENABLED, PreviewOutputEnabled);
 		config_set_string(obs_config,
 			SECTION_NAME, PARAM_PREVIEW_OUTPUT_NAME, PreviewOutputName.toUtf8().constData());
+		config_set_int(obs_config,
+			SECTION_NAME, PARAM_PREVIEW_READBACK_DEPTH, PreviewReadbackDepth);
 		
 		config_save(obs_config);
 	}
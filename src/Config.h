@@ -35,6 +35,7 @@ class Config {
 	QString OutputName;
 	QString PreviewOutputName;
 	bool PreviewOutputEnabled;
+	uint32_t PreviewReadbackDepth;
 
   private:
 	static Config* _instance;
@@ -0,0 +1,300 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "audio-conversion.h"
+#include "obs-ndi.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define MIX_SSE 1
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define MIX_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Past the output planes
+#define MIX_SCRATCH_PLANE MAX_AV_PLANES
+
+// SMPTE 6.1 (L, R, C, LFE, Ls, Rs, Cs) has no OBS layout. It plays as 7.1
+// (FL, FR, FC, LFE, RL, RR, SL, SR): the surrounds go to the sides, and
+// the back centre to both backs at -3 dB.
+static const float six_one_to_seven_one[8][7] = {
+	{ 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f },
+	{ 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f },
+	{ 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f },
+	{ 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f },
+	{ 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.70710678f },
+	{ 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.70710678f },
+	{ 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f },
+	{ 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f },
+};
+
+static enum speaker_layout channel_count_to_layout(int channels)
+{
+	switch (channels) {
+	case 1:
+		return SPEAKERS_MONO;
+	case 2:
+		return SPEAKERS_STEREO;
+	case 3:
+		return SPEAKERS_2POINT1;
+	case 4:
+#if LIBOBS_API_VER >= MAKE_SEMANTIC_VERSION(21, 0, 0)
+		return SPEAKERS_4POINT0;
+#else
+		return SPEAKERS_QUAD;
+#endif
+	case 5:
+		return SPEAKERS_4POINT1;
+	case 6:
+		return SPEAKERS_5POINT1;
+	case 8:
+		return SPEAKERS_7POINT1;
+	default:
+		return SPEAKERS_UNKNOWN;
+	}
+}
+
+// dst += gain * src
+static void mix_accumulate(float* dst, const float* src, float gain,
+	uint32_t count)
+{
+	uint32_t i = 0;
+
+#if defined(MIX_SSE)
+	const __m128 g = _mm_set1_ps(gain);
+	for (; i + 4 <= count; i += 4) {
+		__m128 d = _mm_loadu_ps(dst + i);
+		__m128 s = _mm_loadu_ps(src + i);
+		_mm_storeu_ps(dst + i, _mm_add_ps(d, _mm_mul_ps(s, g)));
+	}
+#elif defined(MIX_NEON)
+	const float32x4_t g = vdupq_n_f32(gain);
+	for (; i + 4 <= count; i += 4) {
+		float32x4_t d = vld1q_f32(dst + i);
+		float32x4_t s = vld1q_f32(src + i);
+		vst1q_f32(dst + i, vmlaq_f32(d, s, g));
+	}
+#endif
+
+	for (; i < count; ++i) {
+		dst[i] += gain * src[i];
+	}
+}
+
+void audio_remap_init(struct audio_remap* remap)
+{
+	memset(remap, 0, sizeof(struct audio_remap));
+}
+
+void audio_remap_free(struct audio_remap* remap)
+{
+	for (int i = 0; i < MAX_AV_PLANES + 1; ++i) {
+		bfree(remap->planes[i]);
+		remap->planes[i] = nullptr;
+	}
+	bfree(remap->gains);
+	remap->gains = nullptr;
+}
+
+// Finds the rows of the mixing matrix that take a single input channel
+// at unit gain
+static void audio_remap_find_routes(struct audio_remap* remap)
+{
+	const int in_channels = remap->in_channels;
+	for (int out = 0; out < remap->out_channels; ++out) {
+		const float* gains = remap->gains + out * in_channels;
+
+		int route = -1;
+		for (int in = 0; in < in_channels; ++in) {
+			if (gains[in] == 0.0f)
+				continue;
+
+			if (route >= 0 || gains[in] != 1.0f) {
+				route = -1;
+				break;
+			}
+			route = in;
+		}
+		remap->routes[out] = route;
+	}
+}
+
+static void audio_remap_build(struct audio_remap* remap, int in_channels,
+	enum audio_channel_mapping mapping)
+{
+	remap->in_channels = in_channels;
+	remap->mapping = mapping;
+
+	bfree(remap->gains);
+	remap->gains = nullptr;
+	remap->mixed = false;
+
+	if (in_channels == 7) {
+		remap->layout = SPEAKERS_7POINT1;
+		remap->out_channels = 8;
+		remap->mixed = true;
+		remap->gains = (float*)bmalloc(sizeof(six_one_to_seven_one));
+		memcpy(remap->gains, six_one_to_seven_one,
+			sizeof(six_one_to_seven_one));
+		audio_remap_find_routes(remap);
+		return;
+	}
+
+	if (in_channels <= 8) {
+		remap->layout = channel_count_to_layout(in_channels);
+		remap->out_channels = in_channels;
+		return;
+	}
+
+	if (mapping == AUDIO_MAPPING_ROUTE) {
+		remap->layout = SPEAKERS_7POINT1;
+		remap->out_channels = 8;
+		return;
+	}
+
+	// Channels of such sources are usually independent feeds: halving the
+	// power per channel added keeps the level of the mix steady
+	remap->layout = SPEAKERS_STEREO;
+	remap->out_channels = 2;
+	remap->mixed = true;
+	remap->gains = (float*)bzalloc(sizeof(float) * 2 * in_channels);
+
+	const int per_side[2] = { (in_channels + 1) / 2, in_channels / 2 };
+	for (int i = 0; i < in_channels; ++i) {
+		const int side = i % 2;
+		remap->gains[side * in_channels + i] =
+			1.0f / sqrtf((float)per_side[side]);
+	}
+	audio_remap_find_routes(remap);
+
+	blog(LOG_INFO, "downmixing %d audio channels to stereo",
+		in_channels);
+}
+
+static float* audio_remap_plane(struct audio_remap* remap, int index,
+	uint32_t samples)
+{
+	if (samples > remap->plane_capacity) {
+		for (int i = 0; i < MAX_AV_PLANES + 1; ++i) {
+			bfree(remap->planes[i]);
+			remap->planes[i] = nullptr;
+		}
+		remap->plane_capacity = samples;
+	}
+
+	if (!remap->planes[index]) {
+		remap->planes[index] =
+			(float*)bmalloc(sizeof(float) * remap->plane_capacity);
+	}
+	return remap->planes[index];
+}
+
+bool audio_remap_process(struct audio_remap* remap,
+	enum audio_channel_mapping mapping, const NDIlib_audio_frame_v2_t* frame,
+	const uint8_t* data[MAX_AV_PLANES], enum speaker_layout* layout)
+{
+	const int in_channels = frame->no_channels;
+	const uint32_t samples = (uint32_t)frame->no_samples;
+	if (in_channels <= 0 || samples == 0 || !frame->p_data)
+		return false;
+
+	if (in_channels != remap->in_channels || mapping != remap->mapping) {
+		audio_remap_build(remap, in_channels, mapping);
+	}
+
+	// A stride of 0 is from senders predating it: planes are packed
+	const size_t stride = frame->channel_stride_in_bytes > 0 ?
+		(size_t)frame->channel_stride_in_bytes :
+		sizeof(float) * samples;
+	const uint8_t* base = (const uint8_t*)frame->p_data;
+
+	*layout = remap->layout;
+	memset(data, 0, sizeof(uint8_t*) * MAX_AV_PLANES);
+
+	// Channels are only read in place as floats when every one of them
+	// starts float-aligned
+	const bool aligned = (stride % sizeof(float)) == 0 &&
+		((uintptr_t)base % sizeof(float)) == 0;
+
+	if (remap->mixed) {
+		for (int out = 0; out < remap->out_channels; ++out) {
+			const int route = remap->routes[out];
+			if (route >= 0 && aligned) {
+				data[out] = base + route * stride;
+				continue;
+			}
+
+			float* plane = audio_remap_plane(remap, out, samples);
+			if (route >= 0) {
+				memcpy(plane, base + route * stride,
+					sizeof(float) * samples);
+				data[out] = (const uint8_t*)plane;
+				continue;
+			}
+
+			memset(plane, 0, sizeof(float) * samples);
+
+			const float* gains = remap->gains + out * in_channels;
+			for (int in = 0; in < in_channels; ++in) {
+				if (gains[in] == 0.0f)
+					continue;
+
+				const uint8_t* channel = base + in * stride;
+				const float* src = (const float*)channel;
+				if (!aligned) {
+					float* scratch = audio_remap_plane(remap,
+						MIX_SCRATCH_PLANE, samples);
+					memcpy(scratch, channel, sizeof(float) * samples);
+					src = scratch;
+				}
+
+				mix_accumulate(plane, src, gains[in], samples);
+			}
+			data[out] = (const uint8_t*)plane;
+		}
+		return true;
+	}
+
+	const int routed = (in_channels < remap->out_channels) ?
+		in_channels : remap->out_channels;
+
+	for (int i = 0; i < routed; ++i) {
+		const uint8_t* channel = base + i * stride;
+		if (aligned) {
+			data[i] = channel;
+			continue;
+		}
+
+		float* plane = audio_remap_plane(remap, i, samples);
+		memcpy(plane, channel, sizeof(float) * samples);
+		data[i] = (const uint8_t*)plane;
+	}
+
+	for (int i = routed; i < remap->out_channels; ++i) {
+		float* plane = audio_remap_plane(remap, i, samples);
+		memset(plane, 0, sizeof(float) * samples);
+		data[i] = (const uint8_t*)plane;
+	}
+
+	return true;
+}
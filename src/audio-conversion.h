@@ -0,0 +1,66 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <obs.h>
+#include <Processing.NDI.Lib.h>
+
+// What to do with the channels of sources that have more than OBS's 8
+enum audio_channel_mapping
+{
+	// The first 8 channels, as 7.1
+	AUDIO_MAPPING_ROUTE,
+	// Every channel, alternately panned left and right
+	AUDIO_MAPPING_DOWNMIX_STEREO
+};
+
+// Takes NDI audio frames to OBS planar float audio. Planes are passed to
+// OBS straight from the NDI frame, honouring its channel stride, whenever
+// possible. Channels are only copied into the remap's own buffers when the
+// stride isn't float-aligned, or when they have to be mixed.
+//
+// Not thread-safe: use one per audio stream.
+struct audio_remap
+{
+	// Mixing matrix, out_channels rows of in_channels gains, rebuilt when
+	// the input channel count or the mapping changes. Rows that only take
+	// one input channel as is route it, without mixing.
+	int in_channels;
+	enum audio_channel_mapping mapping;
+	enum speaker_layout layout;
+	int out_channels;
+	bool mixed;
+	float* gains;
+	int routes[MAX_AV_PLANES];
+
+	// The last plane holds a copy of the input channel being mixed when
+	// it isn't float-aligned
+	float* planes[MAX_AV_PLANES + 1];
+	uint32_t plane_capacity;
+};
+
+void audio_remap_init(struct audio_remap* remap);
+void audio_remap_free(struct audio_remap* remap);
+
+// Fills data and layout for the NDI frame. Data pointers are valid until
+// the NDI frame is freed or the next call, whichever comes first. Returns
+// false if the frame can't be output.
+bool audio_remap_process(struct audio_remap* remap,
+	enum audio_channel_mapping mapping, const NDIlib_audio_frame_v2_t* frame,
+	const uint8_t* data[MAX_AV_PLANES], enum speaker_layout* layout);
@@ -0,0 +1,229 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <errno.h>
+#include <string.h>
+
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <media-io/audio-io.h>
+
+#include "obs-ndi.h"
+#include "audio-send-queue.h"
+#include "connection-monitor.h"
+
+// About 85 ms of audio at 48 kHz with OBS's packet size. One slot is always
+// left empty to tell a full ring from an empty one.
+#define AUDIO_SEND_QUEUE_SLOTS 5
+#define AUDIO_SLOT_FRAMES AUDIO_OUTPUT_FRAMES
+
+struct audio_slot
+{
+	// Planar, one channel every AUDIO_SLOT_FRAMES samples
+	float* data;
+	uint32_t frames;
+	uint32_t channels;
+	uint32_t sample_rate;
+	uint64_t timestamp;
+};
+
+struct audio_send_queue
+{
+	char* name;
+	struct ndi_sender_slot* sender;
+	struct ndi_connection_watch* connections;
+
+	struct audio_slot slots[AUDIO_SEND_QUEUE_SLOTS];
+
+	// Written by the producer and by the sender thread respectively
+	volatile long write_index;
+	volatile long read_index;
+
+	pthread_t thread;
+	bool running;
+	volatile bool stopping;
+	os_event_t* data_event;
+
+	volatile long packets_sent;
+	volatile long overruns;
+	volatile long underruns;
+};
+
+static void audio_send_queue_send(struct audio_send_queue* q,
+	const struct audio_slot* slot)
+{
+	NDIlib_audio_frame_v2_t audio_frame = { 0 };
+	audio_frame.sample_rate = slot->sample_rate;
+	audio_frame.no_channels = slot->channels;
+	audio_frame.timecode = (int64_t)(slot->timestamp / 100);
+	audio_frame.no_samples = slot->frames;
+	audio_frame.channel_stride_in_bytes = AUDIO_SLOT_FRAMES * sizeof(float);
+	audio_frame.p_data = slot->data;
+
+	struct ndi_sender_handle* handle = ndi_sender_acquire(q->sender);
+	if (handle) {
+		ndiLib->NDIlib_send_send_audio_v2(handle->sender, &audio_frame);
+		ndi_sender_handle_release(handle);
+	}
+}
+
+static void* audio_send_thread(void* data)
+{
+	auto q = (struct audio_send_queue*)data;
+	os_set_thread_name("obs-ndi: audio send");
+
+	uint32_t packet_ms = 0;
+	bool starved = false;
+
+	while (!os_atomic_load_bool(&q->stopping)) {
+		long read = os_atomic_load_long(&q->read_index);
+		if (read == os_atomic_load_long(&q->write_index)) {
+			if (packet_ms == 0 || starved) {
+				os_event_wait(q->data_event);
+				continue;
+			}
+
+			if (os_event_timedwait(q->data_event, packet_ms * 2)
+				== ETIMEDOUT)
+			{
+				starved = true;
+				if (ndi_connection_watch_has_receivers(q->connections))
+					os_atomic_inc_long(&q->underruns);
+			}
+			continue;
+		}
+
+		const struct audio_slot* slot = &q->slots[read];
+		audio_send_queue_send(q, slot);
+		packet_ms = (uint32_t)(slot->frames * 1000ULL /
+			slot->sample_rate) + 1;
+		starved = false;
+
+		// Hands the slot back to the producer
+		os_atomic_set_long(&q->read_index,
+			(read + 1) % AUDIO_SEND_QUEUE_SLOTS);
+		os_atomic_inc_long(&q->packets_sent);
+	}
+
+	return nullptr;
+}
+
+struct audio_send_queue* audio_send_queue_create(const char* name,
+	struct ndi_sender_slot* sender, struct ndi_connection_watch* connections)
+{
+	auto q = (struct audio_send_queue*)bzalloc(
+		sizeof(struct audio_send_queue));
+	q->name = bstrdup(name);
+	q->sender = sender;
+	q->connections = connections;
+
+	for (int i = 0; i < AUDIO_SEND_QUEUE_SLOTS; ++i) {
+		q->slots[i].data = (float*)bzalloc(
+			MAX_AUDIO_CHANNELS * AUDIO_SLOT_FRAMES * sizeof(float));
+	}
+
+	os_event_init(&q->data_event, OS_EVENT_TYPE_AUTO);
+	q->running = pthread_create(&q->thread, nullptr,
+		audio_send_thread, q) == 0;
+	if (!q->running) {
+		blog(LOG_ERROR, "'%s': can't start the audio send thread",
+			name);
+	}
+
+	return q;
+}
+
+void audio_send_queue_destroy(struct audio_send_queue* q)
+{
+	if (!q)
+		return;
+
+	if (q->running) {
+		os_atomic_set_bool(&q->stopping, true);
+		os_event_signal(q->data_event);
+		pthread_join(q->thread, nullptr);
+	}
+
+	if (q->overruns || q->underruns) {
+		blog(LOG_INFO, "'%s': audio send: %ld packets sent, "
+			"%ld overruns, %ld underruns", q->name, q->packets_sent,
+			q->overruns, q->underruns);
+	}
+
+	os_event_destroy(q->data_event);
+	for (int i = 0; i < AUDIO_SEND_QUEUE_SLOTS; ++i)
+		bfree(q->slots[i].data);
+	bfree(q->name);
+	bfree(q);
+}
+
+bool audio_send_queue_push(struct audio_send_queue* q,
+	const struct obs_audio_data* audio, uint32_t channels,
+	uint32_t sample_rate)
+{
+	if (!q->running || sample_rate == 0)
+		return false;
+
+	if (channels > MAX_AUDIO_CHANNELS)
+		channels = MAX_AUDIO_CHANNELS;
+
+	bool complete = true;
+	uint32_t offset = 0;
+	while (offset < audio->frames) {
+		long write = os_atomic_load_long(&q->write_index);
+		long next = (write + 1) % AUDIO_SEND_QUEUE_SLOTS;
+		if (next == os_atomic_load_long(&q->read_index)) {
+			os_atomic_inc_long(&q->overruns);
+			complete = false;
+			break;
+		}
+
+		uint32_t frames = audio->frames - offset;
+		if (frames > AUDIO_SLOT_FRAMES)
+			frames = AUDIO_SLOT_FRAMES;
+
+		struct audio_slot* slot = &q->slots[write];
+		for (uint32_t i = 0; i < channels; ++i) {
+			memcpy(&slot->data[i * AUDIO_SLOT_FRAMES],
+				(const float*)audio->data[i] + offset,
+				frames * sizeof(float));
+		}
+		slot->frames = frames;
+		slot->channels = channels;
+		slot->sample_rate = sample_rate;
+		slot->timestamp = audio->timestamp +
+			offset * 1000000000ULL / sample_rate;
+
+		// Publishes the slot to the sender thread
+		os_atomic_set_long(&q->write_index, next);
+		offset += frames;
+	}
+
+	if (offset > 0)
+		os_event_signal(q->data_event);
+	return complete;
+}
+
+void audio_send_queue_get_stats(struct audio_send_queue* q,
+	struct audio_send_queue_stats* stats)
+{
+	stats->packets_sent = (uint64_t)os_atomic_load_long(&q->packets_sent);
+	stats->overruns = (uint64_t)os_atomic_load_long(&q->overruns);
+	stats->underruns = (uint64_t)os_atomic_load_long(&q->underruns);
+}
@@ -0,0 +1,54 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <obs.h>
+
+#include "sender-handle.h"
+
+// Moves the audio send off OBS's audio thread, which every source shares.
+// The audio filter copies each packet into a preallocated single-producer,
+// single-consumer ring and returns; a dedicated thread sends the packets
+// in order. A full ring drops the packet rather than waiting.
+struct audio_send_queue;
+
+struct audio_send_queue_stats
+{
+	uint64_t packets_sent;
+
+	// Packets dropped because the ring was full
+	uint64_t overruns;
+
+	// Times the sender thread went more than two packets without audio
+	// while receivers were connected
+	uint64_t underruns;
+};
+
+struct audio_send_queue* audio_send_queue_create(const char* name,
+	struct ndi_sender_slot* sender, struct ndi_connection_watch* connections);
+void audio_send_queue_destroy(struct audio_send_queue* queue);
+
+// Audio thread: never blocks nor allocates. Packets larger than a ring slot
+// are split. Returns false if some of the packet was dropped.
+bool audio_send_queue_push(struct audio_send_queue* queue,
+	const struct obs_audio_data* audio, uint32_t channels,
+	uint32_t sample_rate);
+
+void audio_send_queue_get_stats(struct audio_send_queue* queue,
+	struct audio_send_queue_stats* stats);
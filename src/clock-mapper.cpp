@@ -0,0 +1,169 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <math.h>
+
+#include "clock-mapper.h"
+
+// Arrivals are only delayed by the network and decoding, never early: the
+// arrival with the smallest delay in each interval is the best estimate of
+// the actual offset between the clocks, and only that one is kept
+#define SAMPLE_INTERVAL_NS 100000000ULL
+
+// Below this many samples, only the offset is estimated
+#define MIN_DRIFT_SAMPLES 16
+
+// Oscillators drift by way less than this: anything more is noise
+#define MAX_DRIFT 0.0005
+
+// An arrival this far off the current mapping means the sender's clock
+// jumped, or the sender changed: start over
+#define MAX_ERROR_NS 1000000000.0
+
+void clock_mapper_init(struct clock_mapper* mapper)
+{
+	pthread_mutex_init(&mapper->mutex, NULL);
+	clock_mapper_reset(mapper);
+}
+
+void clock_mapper_free(struct clock_mapper* mapper)
+{
+	pthread_mutex_destroy(&mapper->mutex);
+}
+
+static void clock_mapper_reset_locked(struct clock_mapper* mapper)
+{
+	mapper->has_reference = false;
+	mapper->count = 0;
+	mapper->next = 0;
+	mapper->slope = 1.0;
+	mapper->intercept = 0.0;
+	mapper->has_candidate = false;
+
+	// The new mapping may well place frames before the previous ones:
+	// clamping them to the old outputs would bunch them up until real
+	// time catches up
+	for (int i = 0; i < CLOCK_MAPPER_STREAM_COUNT; ++i)
+		mapper->last_output[i] = 0;
+}
+
+void clock_mapper_reset(struct clock_mapper* mapper)
+{
+	pthread_mutex_lock(&mapper->mutex);
+	clock_mapper_reset_locked(mapper);
+	pthread_mutex_unlock(&mapper->mutex);
+}
+
+static void clock_mapper_fit(struct clock_mapper* mapper)
+{
+	const uint32_t count = mapper->count;
+
+	double mean_remote = 0.0;
+	double mean_local = 0.0;
+	for (uint32_t i = 0; i < count; ++i) {
+		mean_remote += mapper->remote[i];
+		mean_local += mapper->local[i];
+	}
+	mean_remote /= count;
+	mean_local /= count;
+
+	double slope = 1.0;
+	if (count >= MIN_DRIFT_SAMPLES) {
+		double sxx = 0.0;
+		double sxy = 0.0;
+		for (uint32_t i = 0; i < count; ++i) {
+			double dx = mapper->remote[i] - mean_remote;
+			sxx += dx * dx;
+			sxy += dx * (mapper->local[i] - mean_local);
+		}
+
+		if (sxx > 0.0) {
+			slope = fmin(fmax(sxy / sxx, 1.0 - MAX_DRIFT), 1.0 + MAX_DRIFT);
+		}
+	}
+
+	mapper->slope = slope;
+	mapper->intercept = mean_local - slope * mean_remote;
+}
+
+static void clock_mapper_add_sample(struct clock_mapper* mapper,
+	double remote, double local)
+{
+	mapper->remote[mapper->next] = remote;
+	mapper->local[mapper->next] = local;
+	mapper->next = (mapper->next + 1) % CLOCK_MAPPER_WINDOW;
+	if (mapper->count < CLOCK_MAPPER_WINDOW)
+		mapper->count++;
+
+	clock_mapper_fit(mapper);
+}
+
+uint64_t clock_mapper_map(struct clock_mapper* mapper,
+	enum clock_mapper_stream stream, int64_t remote_ns, uint64_t local_ns)
+{
+	pthread_mutex_lock(&mapper->mutex);
+
+	if (mapper->has_reference) {
+		double remote = (double)(remote_ns - mapper->remote_reference);
+		double local = (double)(int64_t)(local_ns - mapper->local_reference);
+		double predicted = mapper->intercept + mapper->slope * remote;
+
+		if (fabs(local - predicted) > MAX_ERROR_NS) {
+			clock_mapper_reset_locked(mapper);
+		}
+	}
+
+	if (!mapper->has_reference) {
+		mapper->remote_reference = remote_ns;
+		mapper->local_reference = local_ns;
+		mapper->has_reference = true;
+		clock_mapper_add_sample(mapper, 0.0, 0.0);
+		mapper->candidate_start = local_ns;
+	}
+
+	double remote = (double)(remote_ns - mapper->remote_reference);
+	double local = (double)(int64_t)(local_ns - mapper->local_reference);
+
+	// Keep the least delayed arrival of the interval
+	if (!mapper->has_candidate ||
+		local - remote < mapper->candidate_local - mapper->candidate_remote)
+	{
+		mapper->candidate_remote = remote;
+		mapper->candidate_local = local;
+		mapper->has_candidate = true;
+	}
+
+	if (local_ns - mapper->candidate_start >= SAMPLE_INTERVAL_NS) {
+		clock_mapper_add_sample(mapper, mapper->candidate_remote,
+			mapper->candidate_local);
+		mapper->has_candidate = false;
+		mapper->candidate_start = local_ns;
+	}
+
+	double mapped = mapper->intercept + mapper->slope * remote;
+	uint64_t output = mapper->local_reference + (int64_t)llround(mapped);
+
+	uint64_t* last_output = &mapper->last_output[stream];
+	if (output <= *last_output) {
+		output = *last_output + 1;
+	}
+	*last_output = output;
+
+	pthread_mutex_unlock(&mapper->mutex);
+	return output;
+}
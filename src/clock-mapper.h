@@ -0,0 +1,79 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <util/threading.h>
+
+#define CLOCK_MAPPER_WINDOW 128
+
+enum clock_mapper_stream
+{
+	CLOCK_MAPPER_VIDEO,
+	CLOCK_MAPPER_AUDIO,
+	CLOCK_MAPPER_STREAM_COUNT
+};
+
+// Maps timestamps from a sender's clock to the local (os_gettime_ns) clock.
+// The mapping is a least-squares fit of the local arrival times against the
+// sender timestamps, over the least delayed arrival of each of the last
+// CLOCK_MAPPER_WINDOW 100 ms intervals. It follows both the offset and the
+// drift between the two clocks while smoothing out network and decoding
+// jitter. Audio and video go through the
+// same mapping, which preserves their relative timing as sent.
+//
+// Thread-safe: audio and video can be mapped from different threads.
+struct clock_mapper
+{
+	pthread_mutex_t mutex;
+
+	// Samples are relative to the first one, for precision
+	bool has_reference;
+	int64_t remote_reference;
+	uint64_t local_reference;
+
+	double remote[CLOCK_MAPPER_WINDOW];
+	double local[CLOCK_MAPPER_WINDOW];
+	uint32_t count;
+	uint32_t next;
+
+	// local = intercept + slope * remote
+	double slope;
+	double intercept;
+
+	// Least delayed arrival since candidate_start
+	bool has_candidate;
+	double candidate_remote;
+	double candidate_local;
+	uint64_t candidate_start;
+
+	uint64_t last_output[CLOCK_MAPPER_STREAM_COUNT];
+};
+
+void clock_mapper_init(struct clock_mapper* mapper);
+void clock_mapper_free(struct clock_mapper* mapper);
+
+// Forgets the current mapping, when the sender's clock changes
+void clock_mapper_reset(struct clock_mapper* mapper);
+
+// Adds a frame sent at remote_ns (sender clock) and received at local_ns,
+// and returns its time on the local clock. Timestamps returned for a given
+// stream are strictly increasing, except across resets of the mapping.
+uint64_t clock_mapper_map(struct clock_mapper* mapper,
+	enum clock_mapper_stream stream, int64_t remote_ns, uint64_t local_ns);
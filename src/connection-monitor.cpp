@@ -0,0 +1,145 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <errno.h>
+#include <obs-module.h>
+#include <util/threading.h>
+
+#include "obs-ndi.h"
+#include "connection-monitor.h"
+
+#define CONNECTION_POLL_INTERVAL_MS 10
+
+struct ndi_connection_watch
+{
+	char* name;
+	NDIlib_send_instance_t sender;
+	volatile bool has_receivers;
+
+	struct ndi_connection_watch* next;
+};
+
+static struct {
+	pthread_mutex_t mutex;
+	pthread_t thread;
+	os_event_t* stop_event;
+	bool running;
+	struct ndi_connection_watch* watches;
+} monitor;
+
+static void* connection_monitor_thread(void* data)
+{
+	UNUSED_PARAMETER(data);
+	os_set_thread_name("obs-ndi: connection monitor");
+
+	while (os_event_timedwait(monitor.stop_event,
+		CONNECTION_POLL_INTERVAL_MS) == ETIMEDOUT)
+	{
+		pthread_mutex_lock(&monitor.mutex);
+		for (auto w = monitor.watches; w; w = w->next) {
+			if (!w->sender)
+				continue;
+
+			bool has_receivers =
+				ndiLib->NDIlib_send_get_no_connections(w->sender, 0) > 0;
+			bool had_receivers =
+				os_atomic_set_bool(&w->has_receivers, has_receivers);
+
+			if (has_receivers != had_receivers) {
+				blog(LOG_INFO, "'%s': %s", w->name, has_receivers ?
+					"receivers connected, resuming" :
+					"no receivers left, going idle");
+			}
+		}
+		pthread_mutex_unlock(&monitor.mutex);
+	}
+
+	return nullptr;
+}
+
+void connection_monitor_init()
+{
+	pthread_mutex_init(&monitor.mutex, NULL);
+	os_event_init(&monitor.stop_event, OS_EVENT_TYPE_MANUAL);
+	monitor.watches = nullptr;
+
+	monitor.running = pthread_create(&monitor.thread, nullptr,
+		connection_monitor_thread, nullptr) == 0;
+}
+
+void connection_monitor_deinit()
+{
+	if (!monitor.stop_event)
+		return;
+
+	if (monitor.running) {
+		os_event_signal(monitor.stop_event);
+		pthread_join(monitor.thread, nullptr);
+		monitor.running = false;
+	}
+
+	os_event_destroy(monitor.stop_event);
+	monitor.stop_event = nullptr;
+	pthread_mutex_destroy(&monitor.mutex);
+}
+
+struct ndi_connection_watch* ndi_connection_watch_create(const char* name)
+{
+	auto w = (struct ndi_connection_watch*)bzalloc(
+		sizeof(struct ndi_connection_watch));
+	w->name = bstrdup(name);
+
+	pthread_mutex_lock(&monitor.mutex);
+	w->next = monitor.watches;
+	monitor.watches = w;
+	pthread_mutex_unlock(&monitor.mutex);
+
+	return w;
+}
+
+void ndi_connection_watch_destroy(struct ndi_connection_watch* watch)
+{
+	if (!watch)
+		return;
+
+	pthread_mutex_lock(&monitor.mutex);
+	for (auto w = &monitor.watches; *w; w = &(*w)->next) {
+		if (*w == watch) {
+			*w = watch->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&monitor.mutex);
+
+	bfree(watch->name);
+	bfree(watch);
+}
+
+void ndi_connection_watch_set_sender(struct ndi_connection_watch* watch,
+	NDIlib_send_instance_t sender)
+{
+	pthread_mutex_lock(&monitor.mutex);
+	watch->sender = sender;
+	os_atomic_set_bool(&watch->has_receivers, false);
+	pthread_mutex_unlock(&monitor.mutex);
+}
+
+bool ndi_connection_watch_has_receivers(struct ndi_connection_watch* watch)
+{
+	return watch && os_atomic_load_bool(&watch->has_receivers);
+}
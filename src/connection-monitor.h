@@ -0,0 +1,41 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <Processing.NDI.Lib.h>
+
+// Senders are polled for receivers by a single background thread, so that
+// render and send paths can check whether anyone is watching without calling
+// into the NDI library. The poll interval is shorter than a frame at usual
+// frame rates: a sender resumes within one frame of a receiver connecting.
+void connection_monitor_init();
+void connection_monitor_deinit();
+
+struct ndi_connection_watch;
+
+struct ndi_connection_watch* ndi_connection_watch_create(const char* name);
+void ndi_connection_watch_destroy(struct ndi_connection_watch* watch);
+
+// Attaches the watch to a sender, or detaches it when sender is null. Once
+// this returns, the monitor thread doesn't use the previous sender anymore.
+void ndi_connection_watch_set_sender(struct ndi_connection_watch* watch,
+	NDIlib_send_instance_t sender);
+
+// Lock-free. False until the first poll after a sender is attached.
+bool ndi_connection_watch_has_receivers(struct ndi_connection_watch* watch);
@@ -0,0 +1,170 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#include "obs-ndi.h"
+#include "conversion-pool.h"
+
+#define MAX_POOL_SIZE 16
+
+struct conversion_worker
+{
+	struct conversion_pool* pool;
+	uint32_t index;
+	pthread_t thread;
+	os_sem_t* start_sem;
+};
+
+struct conversion_pool
+{
+	uint32_t size;
+	struct conversion_worker* workers;
+	os_sem_t* done_sem;
+	bool running;
+
+	// Current job, only written while all workers are idle
+	uyvy_conv_function conv_function;
+	uint8_t** input;
+	uint32_t* in_linesize;
+	uint32_t height;
+	uint8_t* output;
+	uint32_t out_linesize;
+};
+
+static void conversion_pool_run_band(struct conversion_pool* pool,
+	uint32_t index)
+{
+	uint32_t start_y = (uint32_t)((uint64_t)pool->height * index / pool->size);
+	uint32_t end_y =
+		(uint32_t)((uint64_t)pool->height * (index + 1) / pool->size);
+
+	if (start_y < end_y) {
+		pool->conv_function(pool->input, pool->in_linesize,
+			start_y, end_y, pool->output, pool->out_linesize);
+	}
+}
+
+static void* conversion_worker_thread(void* data)
+{
+	auto w = (struct conversion_worker*)data;
+	struct conversion_pool* pool = w->pool;
+
+	os_set_thread_name("obs-ndi: conversion worker");
+
+	while (os_sem_wait(w->start_sem) == 0) {
+		if (!pool->running)
+			break;
+
+		conversion_pool_run_band(pool, w->index);
+		os_sem_post(pool->done_sem);
+	}
+
+	return nullptr;
+}
+
+uint32_t conversion_pool_default_size()
+{
+	// Leave the remaining cores to OBS's own video and encoder threads
+	int cores = os_get_physical_cores();
+	uint32_t size = (cores > 1) ? (uint32_t)(cores / 2) : 1;
+	return (size < 4) ? size : 4;
+}
+
+struct conversion_pool* conversion_pool_create(uint32_t size)
+{
+	if (size == 0)
+		size = conversion_pool_default_size();
+	if (size > MAX_POOL_SIZE)
+		size = MAX_POOL_SIZE;
+
+	auto pool =
+		(struct conversion_pool*)bzalloc(sizeof(struct conversion_pool));
+	pool->size = size;
+	pool->running = true;
+	os_sem_init(&pool->done_sem, 0);
+
+	// The calling thread converts the last band itself
+	uint32_t worker_count = size - 1;
+	if (worker_count > 0) {
+		pool->workers = (struct conversion_worker*)bzalloc(
+			sizeof(struct conversion_worker) * worker_count);
+	}
+
+	for (uint32_t i = 0; i < worker_count; ++i) {
+		struct conversion_worker* w = &pool->workers[i];
+		w->pool = pool;
+		w->index = i;
+		os_sem_init(&w->start_sem, 0);
+		pthread_create(&w->thread, nullptr, conversion_worker_thread, w);
+	}
+
+	return pool;
+}
+
+void conversion_pool_destroy(struct conversion_pool* pool)
+{
+	if (!pool)
+		return;
+
+	uint32_t worker_count = pool->size - 1;
+
+	pool->running = false;
+	for (uint32_t i = 0; i < worker_count; ++i) {
+		os_sem_post(pool->workers[i].start_sem);
+	}
+	for (uint32_t i = 0; i < worker_count; ++i) {
+		pthread_join(pool->workers[i].thread, nullptr);
+		os_sem_destroy(pool->workers[i].start_sem);
+	}
+
+	os_sem_destroy(pool->done_sem);
+	bfree(pool->workers);
+	bfree(pool);
+}
+
+uint32_t conversion_pool_get_size(struct conversion_pool* pool)
+{
+	return pool ? pool->size : 0;
+}
+
+void conversion_pool_run(struct conversion_pool* pool,
+	uyvy_conv_function conv_function,
+	uint8_t* input[], uint32_t in_linesize[], uint32_t height,
+	uint8_t* output, uint32_t out_linesize)
+{
+	pool->conv_function = conv_function;
+	pool->input = input;
+	pool->in_linesize = in_linesize;
+	pool->height = height;
+	pool->output = output;
+	pool->out_linesize = out_linesize;
+
+	uint32_t worker_count = pool->size - 1;
+	for (uint32_t i = 0; i < worker_count; ++i) {
+		os_sem_post(pool->workers[i].start_sem);
+	}
+
+	conversion_pool_run_band(pool, worker_count);
+
+	for (uint32_t i = 0; i < worker_count; ++i) {
+		os_sem_wait(pool->done_sem);
+	}
+}
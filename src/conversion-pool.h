@@ -0,0 +1,39 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include "pixel-conversion.h"
+
+struct conversion_pool;
+
+// Suggested pool size for the machine OBS is running on
+uint32_t conversion_pool_default_size();
+
+// A pool of size N converts frames in N row bands: N - 1 persistent worker
+// threads each take a band, and the calling thread converts the last one.
+struct conversion_pool* conversion_pool_create(uint32_t size);
+void conversion_pool_destroy(struct conversion_pool* pool);
+uint32_t conversion_pool_get_size(struct conversion_pool* pool);
+
+// Runs conv_function over rows 0..height split across the pool, and
+// returns once every band has been converted.
+void conversion_pool_run(struct conversion_pool* pool,
+	uyvy_conv_function conv_function,
+	uint8_t* input[], uint32_t in_linesize[], uint32_t height,
+	uint8_t* output, uint32_t out_linesize);
@@ -0,0 +1,227 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <string.h>
+
+#include "deinterlace.h"
+#include <util/bmem.h>
+
+// Largest difference, per byte, between the opposite field and the
+// interpolated line for the adaptive mode to consider the picture still
+#define MOTION_THRESHOLD 12
+
+static int bytes_per_pixel(NDIlib_FourCC_type_e fourcc)
+{
+	switch (fourcc) {
+		case NDIlib_FourCC_type_UYVY:
+		case NDIlib_FourCC_type_UYVA:
+			return 2;
+		case NDIlib_FourCC_type_BGRA:
+		case NDIlib_FourCC_type_BGRX:
+		case NDIlib_FourCC_type_RGBA:
+		case NDIlib_FourCC_type_RGBX:
+			return 4;
+		default:
+			return 0;
+	}
+}
+
+// UYVA frames are followed by a plane of alpha, one byte per pixel
+static int frame_planes(NDIlib_FourCC_type_e fourcc, int xres,
+	int yres, int line_stride, size_t offsets[2], size_t strides[2])
+{
+	offsets[0] = 0;
+	strides[0] = (size_t)line_stride;
+	if (fourcc != NDIlib_FourCC_type_UYVA)
+		return 1;
+
+	offsets[1] = (size_t)line_stride * yres;
+	strides[1] = (size_t)xres;
+	return 2;
+}
+
+static void deinterlacer_set_layout(struct deinterlacer* d,
+	NDIlib_FourCC_type_e fourcc, int xres, int yres, int line_stride)
+{
+	if (d->fourcc == fourcc && d->xres == xres && d->yres == yres &&
+		d->line_stride == line_stride)
+		return;
+
+	d->fourcc = fourcc;
+	d->xres = xres;
+	d->yres = yres;
+	d->line_stride = line_stride;
+
+	d->frame_size = (size_t)line_stride * yres;
+	if (fourcc == NDIlib_FourCC_type_UYVA)
+		d->frame_size += (size_t)xres * yres;
+
+	d->fields = (uint8_t*)brealloc(d->fields, d->frame_size);
+	d->output[0] = (uint8_t*)brealloc(d->output[0], d->frame_size);
+	d->output[1] = (uint8_t*)brealloc(d->output[1], d->frame_size);
+	deinterlacer_reset(d);
+}
+
+// Copies the lines of src of the given parity to dst and rebuilds the
+// others. With adaptive set, src must also hold the opposite field.
+static void deinterlacer_interpolate(struct deinterlacer* d,
+	const uint8_t* src, int parity, bool adaptive, uint8_t* dst)
+{
+	size_t offsets[2], strides[2];
+	int planes = frame_planes(d->fourcc, d->xres, d->yres, d->line_stride,
+		offsets, strides);
+
+	for (int p = 0; p < planes; ++p) {
+		const uint8_t* in = src + offsets[p];
+		uint8_t* out = dst + offsets[p];
+		const size_t stride = strides[p];
+
+		for (int y = 0; y < d->yres; ++y) {
+			const uint8_t* line = in + (size_t)y * stride;
+			if ((y & 1) == parity) {
+				memcpy(out + (size_t)y * stride, line, stride);
+				continue;
+			}
+
+			int above = (y > 0) ? y - 1 : y + 1;
+			int below = (y + 1 < d->yres) ? y + 1 : y - 1;
+			d->interpolate(in + (size_t)above * stride,
+				in + (size_t)below * stride,
+				adaptive ? line : nullptr,
+				out + (size_t)y * stride, stride, MOTION_THRESHOLD);
+		}
+	}
+}
+
+// Stores the lines of a field frame in the woven frame
+static void deinterlacer_store_field(struct deinterlacer* d,
+	const NDIlib_video_frame_v2_t* frame, int parity)
+{
+	size_t field_offsets[2], offsets[2], strides[2];
+	frame_planes(d->fourcc, d->xres, frame->yres, d->line_stride,
+		field_offsets, strides);
+	int planes = frame_planes(d->fourcc, d->xres, d->yres, d->line_stride,
+		offsets, strides);
+
+	for (int p = 0; p < planes; ++p) {
+		for (int y = 0; y < frame->yres; ++y) {
+			memcpy(d->fields + offsets[p] + (size_t)(y * 2 + parity) * strides[p],
+				frame->p_data + field_offsets[p] + (size_t)y * strides[p],
+				strides[p]);
+		}
+	}
+
+	d->have_field[parity] = true;
+}
+
+void deinterlacer_init(struct deinterlacer* d)
+{
+	memset(d, 0, sizeof(struct deinterlacer));
+	d->interpolate = get_field_line_function(nullptr);
+}
+
+void deinterlacer_free(struct deinterlacer* d)
+{
+	bfree(d->fields);
+	bfree(d->output[0]);
+	bfree(d->output[1]);
+	memset(d, 0, sizeof(struct deinterlacer));
+}
+
+void deinterlacer_reset(struct deinterlacer* d)
+{
+	d->have_field[0] = false;
+	d->have_field[1] = false;
+}
+
+int deinterlacer_process(struct deinterlacer* d, enum deinterlace_mode mode,
+	const NDIlib_video_frame_v2_t* frame, struct deinterlaced_frame out[2])
+{
+	out[0].frame = *frame;
+	out[0].delay_ns = 0;
+
+	const NDIlib_frame_format_type_e format = frame->frame_format_type;
+	if (format == NDIlib_frame_format_type_progressive ||
+		(format == NDIlib_frame_format_type_interleaved &&
+			mode == DEINTERLACE_WEAVE) ||
+		bytes_per_pixel(frame->FourCC) == 0 || frame->yres < 1)
+	{
+		return 1;
+	}
+
+	const bool fields = (format != NDIlib_frame_format_type_interleaved);
+	const bool adaptive = (mode == DEINTERLACE_ADAPTIVE);
+
+	deinterlacer_set_layout(d, frame->FourCC, frame->xres,
+		fields ? frame->yres * 2 : frame->yres,
+		frame->line_stride_in_bytes);
+
+	out[0].frame.frame_format_type = NDIlib_frame_format_type_progressive;
+	out[0].frame.yres = d->yres;
+
+	if (!fields) {
+		// Both fields of the frame, the first one (even lines) first.
+		// Output at twice the frame rate.
+		int64_t half_frame = 0;
+		if (frame->frame_rate_N > 0) {
+			half_frame = 10000000LL * frame->frame_rate_D /
+				(2LL * frame->frame_rate_N);
+		}
+
+		for (int f = 0; f < 2; ++f) {
+			deinterlacer_interpolate(d, frame->p_data, f, adaptive,
+				d->output[f]);
+
+			out[f].frame = out[0].frame;
+			out[f].frame.p_data = d->output[f];
+			out[f].frame.frame_rate_N *= 2;
+		}
+
+		if (frame->timestamp != NDIlib_recv_timestamp_undefined)
+			out[1].frame.timestamp += half_frame;
+		out[1].frame.timecode += half_frame;
+		out[1].delay_ns = (uint64_t)half_frame * 100;
+		return 2;
+	}
+
+	// Field frames carry the frame rate, and arrive at twice that rate
+	const int parity = (format == NDIlib_frame_format_type_field_1) ? 1 : 0;
+	deinterlacer_store_field(d, frame, parity);
+
+	if (mode == DEINTERLACE_WEAVE) {
+		if (parity == 0) {
+			d->field_timestamp = frame->timestamp;
+			d->field_timecode = frame->timecode;
+			return 0;
+		}
+		if (!d->have_field[0])
+			return 0;
+
+		out[0].frame.p_data = d->fields;
+		out[0].frame.timestamp = d->field_timestamp;
+		out[0].frame.timecode = d->field_timecode;
+		deinterlacer_reset(d);
+		return 1;
+	}
+
+	deinterlacer_interpolate(d, d->fields, parity,
+		adaptive && d->have_field[1 - parity], d->output[0]);
+	out[0].frame.p_data = d->output[0];
+	out[0].frame.frame_rate_N *= 2;
+	return 1;
+}
@@ -0,0 +1,77 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <Processing.NDI.Lib.h>
+
+#include "pixel-conversion.h"
+
+enum deinterlace_mode
+{
+	// Fields are paired back into full frames
+	DEINTERLACE_WEAVE,
+	// Each field is output on its own, missing lines interpolated
+	DEINTERLACE_BOB,
+	// As bob, but still parts of the picture keep the opposite field's lines
+	DEINTERLACE_ADAPTIVE
+};
+
+struct deinterlaced_frame
+{
+	NDIlib_video_frame_v2_t frame;
+	// Time from the received frame to this one
+	uint64_t delay_ns;
+};
+
+// Turns interleaved and field-based NDI frames into progressive ones, of
+// the same FourCC. Only 8-bit packed formats and UYVA are supported, other
+// frames are passed through.
+//
+// Not thread-safe: use one per video stream.
+struct deinterlacer
+{
+	field_line_function interpolate;
+
+	// Layout of the full frames, buffers are reset when it changes
+	NDIlib_FourCC_type_e fourcc;
+	int xres;
+	int yres;
+	int line_stride;
+
+	// Latest field of each parity, woven into a full frame
+	uint8_t* fields;
+	bool have_field[2];
+	int64_t field_timestamp;
+	int64_t field_timecode;
+
+	uint8_t* output[2];
+	size_t frame_size;
+};
+
+void deinterlacer_init(struct deinterlacer* d);
+void deinterlacer_free(struct deinterlacer* d);
+
+// Forgets the received fields
+void deinterlacer_reset(struct deinterlacer* d);
+
+// Fills out with the progressive frames to output for frame and returns
+// their count, up to 2. They are valid until the next call.
+int deinterlacer_process(struct deinterlacer* d, enum deinterlace_mode mode,
+	const NDIlib_video_frame_v2_t* frame, struct deinterlaced_frame out[2]);
@@ -0,0 +1,160 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <string.h>
+
+#include "frame-pool.h"
+
+static uint32_t plane_height(enum video_format format, int plane,
+	uint32_t height)
+{
+	if (plane == 0)
+		return height;
+
+	switch (format) {
+		case VIDEO_FORMAT_I420:
+		case VIDEO_FORMAT_NV12:
+			return height / 2;
+		default:
+			return height;
+	}
+}
+
+void frame_pool_init(struct frame_pool* pool)
+{
+	memset(pool, 0, sizeof(struct frame_pool));
+	pthread_mutex_init(&pool->mutex, NULL);
+}
+
+void frame_pool_free(struct frame_pool* pool)
+{
+	for (uint32_t i = 0; i < pool->count; ++i)
+		obs_source_frame_destroy(pool->frames[i]);
+
+	pthread_mutex_destroy(&pool->mutex);
+	memset(pool, 0, sizeof(struct frame_pool));
+}
+
+struct obs_source_frame* frame_pool_get(struct frame_pool* pool,
+	enum video_format format, uint32_t width, uint32_t height)
+{
+	struct obs_source_frame* stale[FRAME_POOL_CAPACITY];
+	uint32_t stale_count = 0;
+	struct obs_source_frame* frame = nullptr;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	if (pool->format != format || pool->width != width ||
+		pool->height != height)
+	{
+		memcpy(stale, pool->frames,
+			sizeof(struct obs_source_frame*) * pool->count);
+		stale_count = pool->count;
+		pool->count = 0;
+
+		pool->format = format;
+		pool->width = width;
+		pool->height = height;
+	}
+
+	if (pool->count > 0) {
+		frame = pool->frames[--pool->count];
+	} else {
+		pool->stats.allocations++;
+	}
+	pool->stats.frames++;
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (uint32_t i = 0; i < stale_count; ++i)
+		obs_source_frame_destroy(stale[i]);
+
+	if (!frame)
+		frame = obs_source_frame_create(format, width, height);
+	return frame;
+}
+
+void frame_pool_release(struct frame_pool* pool,
+	struct obs_source_frame* frame)
+{
+	if (!frame)
+		return;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	bool kept = false;
+	if (frame->format == pool->format && frame->width == pool->width &&
+		frame->height == pool->height && pool->count < FRAME_POOL_CAPACITY)
+	{
+		pool->frames[pool->count++] = frame;
+		kept = true;
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (!kept)
+		obs_source_frame_destroy(frame);
+}
+
+void frame_pool_copy_to(struct frame_pool* pool,
+	struct obs_source_frame* dst, const struct obs_source_frame* src)
+{
+	uint64_t copied = 0;
+
+	for (int i = 0; i < MAX_AV_PLANES; ++i) {
+		if (!src->data[i] || !dst->data[i] || src->data[i] == dst->data[i])
+			continue;
+
+		const uint32_t rows = plane_height(src->format, i, src->height);
+		const uint32_t row_size = (src->linesize[i] < dst->linesize[i]) ?
+			src->linesize[i] : dst->linesize[i];
+
+		if (src->linesize[i] == dst->linesize[i]) {
+			memcpy(dst->data[i], src->data[i],
+				(size_t)src->linesize[i] * rows);
+		} else {
+			for (uint32_t y = 0; y < rows; ++y) {
+				memcpy(dst->data[i] + (size_t)y * dst->linesize[i],
+					src->data[i] + (size_t)y * src->linesize[i],
+					row_size);
+			}
+		}
+		copied += (uint64_t)row_size * rows;
+	}
+
+	dst->timestamp = src->timestamp;
+	dst->full_range = src->full_range;
+	dst->flip = src->flip;
+	memcpy(dst->color_matrix, src->color_matrix, sizeof(dst->color_matrix));
+	memcpy(dst->color_range_min, src->color_range_min,
+		sizeof(dst->color_range_min));
+	memcpy(dst->color_range_max, src->color_range_max,
+		sizeof(dst->color_range_max));
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->stats.bytes_copied += copied;
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+void frame_pool_get_stats(struct frame_pool* pool,
+	struct frame_pool_stats* stats)
+{
+	pthread_mutex_lock(&pool->mutex);
+	*stats = pool->stats;
+	pthread_mutex_unlock(&pool->mutex);
+}
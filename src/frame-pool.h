@@ -0,0 +1,74 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <obs.h>
+#include <util/threading.h>
+
+// Enough for a full jitter buffer plus the frames being filled and output
+#define FRAME_POOL_CAPACITY 20
+
+struct frame_pool_stats
+{
+	// Frames handed out, frames that had to be allocated for that, and
+	// bytes the plugin copied into them
+	uint64_t frames;
+	uint64_t allocations;
+	uint64_t bytes_copied;
+};
+
+// Recycles obs_source_frame buffers of the current video layout, so that
+// frames kept by the plugin (converted or queued for later output) don't
+// cost an allocation each. Free frames of another layout are dropped as
+// soon as a frame of the new one is requested.
+//
+// Thread-safe.
+struct frame_pool
+{
+	pthread_mutex_t mutex;
+
+	enum video_format format;
+	uint32_t width;
+	uint32_t height;
+
+	struct obs_source_frame* frames[FRAME_POOL_CAPACITY];
+	uint32_t count;
+
+	struct frame_pool_stats stats;
+};
+
+void frame_pool_init(struct frame_pool* pool);
+void frame_pool_free(struct frame_pool* pool);
+
+// Returns a frame of the given layout. Pixels and properties are left
+// from its previous use.
+struct obs_source_frame* frame_pool_get(struct frame_pool* pool,
+	enum video_format format, uint32_t width, uint32_t height);
+
+// Takes back a frame returned by frame_pool_get
+void frame_pool_release(struct frame_pool* pool,
+	struct obs_source_frame* frame);
+
+// Copies the pixels and properties of src to dst, which must have the same
+// layout. Planes src already shares with dst aren't copied.
+void frame_pool_copy_to(struct frame_pool* pool,
+	struct obs_source_frame* dst, const struct obs_source_frame* src);
+
+void frame_pool_get_stats(struct frame_pool* pool,
+	struct frame_pool_stats* stats);
@@ -0,0 +1,74 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "gpu-packing.h"
+
+void gpu_packing_color_matrix(enum video_colorspace colorspace,
+	enum video_range_type range, struct matrix4* color_matrix)
+{
+	// OBS gives the YUV to RGB matrix, rows applied to (Y, U, V, 1)
+	float range_min[3];
+	float range_max[3];
+	video_format_get_parameters(colorspace, range, (float*)color_matrix,
+		range_min, range_max);
+	matrix4_inv(color_matrix, color_matrix);
+}
+
+gs_texture_t* gpu_packing_render(gs_effect_t* effect,
+	gs_texrender_t* texrender, gs_texture_t* texture, bool alpha,
+	uint32_t width, uint32_t height, uint32_t rows,
+	const struct matrix4* color_matrix)
+{
+	const uint32_t out_width = width / 2;
+
+	gs_texrender_reset(texrender);
+	if (!gs_texrender_begin(texrender, out_width, rows))
+		return nullptr;
+
+	struct vec2 base_size;
+	struct vec2 output_size;
+	vec2_set(&base_size, (float)width, (float)height);
+	vec2_set(&output_size, (float)out_width, (float)rows);
+
+	gs_effect_set_texture(gs_effect_get_param_by_name(effect, "image"),
+		texture);
+	gs_effect_set_vec4(gs_effect_get_param_by_name(effect, "color_vec_y"),
+		&color_matrix->x);
+	gs_effect_set_vec4(gs_effect_get_param_by_name(effect, "color_vec_u"),
+		&color_matrix->y);
+	gs_effect_set_vec4(gs_effect_get_param_by_name(effect, "color_vec_v"),
+		&color_matrix->z);
+	gs_effect_set_vec2(gs_effect_get_param_by_name(effect, "base_size"),
+		&base_size);
+	gs_effect_set_vec2(gs_effect_get_param_by_name(effect, "output_size"),
+		&output_size);
+
+	gs_ortho(0.0f, (float)out_width, 0.0f, (float)rows, -100.0f, 100.0f);
+
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+
+	const char* technique = alpha ? "ConvertUYVA" : "ConvertUYVY";
+	while (gs_effect_loop(effect, technique))
+		gs_draw_sprite(texture, 0, out_width, rows);
+
+	gs_blend_state_pop();
+	gs_texrender_end(texrender);
+
+	return gs_texrender_get_texture(texrender);
+}
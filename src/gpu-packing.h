@@ -0,0 +1,40 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <obs.h>
+#include <graphics/matrix4.h>
+
+// Packing of BGRA renders to NDI's UYVY and UYVA on the GPU, with
+// data/ndi-convert.effect. Shared by the NDI filter and the packing check
+// tool. Graphics thread only.
+
+// RGB to Y, U and V rows, offset in w, for colorspace and range: the
+// inverse of the matrix OBS converts YUV to RGB with
+void gpu_packing_color_matrix(enum video_colorspace colorspace,
+	enum video_range_type range, struct matrix4* color_matrix);
+
+// Renders texture, width by height, packed into texrender, one RGBA texel
+// per pair of pixels and rows rows high. With alpha, the rows past the
+// image hold the UYVA alpha plane. Returns the packed texture, or null if
+// texrender can't be rendered to.
+gs_texture_t* gpu_packing_render(gs_effect_t* effect,
+	gs_texrender_t* texrender, gs_texture_t* texture, bool alpha,
+	uint32_t width, uint32_t height, uint32_t rows,
+	const struct matrix4* color_matrix);
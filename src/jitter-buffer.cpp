@@ -0,0 +1,171 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <string.h>
+
+#include "jitter-buffer.h"
+#include "obs-ndi.h"
+
+// Peak delay decay per frame: at 60 fps, it halves in about 2 seconds
+#define PEAK_DECAY 0.995
+
+// Kept on top of the peak delay
+#define DEPTH_MARGIN_NS 2000000ULL
+
+void jitter_buffer_init(struct jitter_buffer* jb, struct clock_mapper* clock,
+	struct frame_pool* pool)
+{
+	memset(jb, 0, sizeof(struct jitter_buffer));
+	jb->clock = clock;
+	jb->pool = pool;
+	pthread_mutex_init(&jb->mutex, NULL);
+}
+
+static void jitter_buffer_clear_locked(struct jitter_buffer* jb)
+{
+	for (uint32_t i = 0; i < jb->count; ++i) {
+		uint32_t index = (jb->first + i) % JITTER_BUFFER_CAPACITY;
+		frame_pool_release(jb->pool, jb->frames[index]);
+		jb->frames[index] = nullptr;
+	}
+
+	jb->first = 0;
+	jb->count = 0;
+	jb->peak_delay_ns = 0.0;
+	jb->depth_ns = 0;
+}
+
+void jitter_buffer_free(struct jitter_buffer* jb)
+{
+	jitter_buffer_clear_locked(jb);
+	pthread_mutex_destroy(&jb->mutex);
+}
+
+void jitter_buffer_clear(struct jitter_buffer* jb)
+{
+	pthread_mutex_lock(&jb->mutex);
+	jitter_buffer_clear_locked(jb);
+	pthread_mutex_unlock(&jb->mutex);
+}
+
+void jitter_buffer_set_max_depth(struct jitter_buffer* jb, uint32_t max_ms)
+{
+	pthread_mutex_lock(&jb->mutex);
+	jb->max_depth_ns = (uint64_t)max_ms * 1000000ULL;
+	pthread_mutex_unlock(&jb->mutex);
+}
+
+void jitter_buffer_push(struct jitter_buffer* jb,
+	struct obs_source_frame* frame, int64_t ndi_timestamp,
+	uint64_t local_ts)
+{
+	struct obs_source_frame* dropped = nullptr;
+
+	pthread_mutex_lock(&jb->mutex);
+
+	uint64_t nominal_ts = local_ts;
+	if (ndi_timestamp != NDIlib_recv_timestamp_undefined) {
+		nominal_ts = clock_mapper_map(jb->clock, CLOCK_MAPPER_VIDEO,
+			ndi_timestamp * 100, local_ts);
+	}
+
+	const double delay =
+		(local_ts > nominal_ts) ? (double)(local_ts - nominal_ts) : 0.0;
+	jb->peak_delay_ns *= PEAK_DECAY;
+	if (delay > jb->peak_delay_ns)
+		jb->peak_delay_ns = delay;
+
+	uint64_t depth = (uint64_t)jb->peak_delay_ns + DEPTH_MARGIN_NS;
+	jb->depth_ns = (depth < jb->max_depth_ns) ? depth : jb->max_depth_ns;
+
+	uint64_t due_ts = nominal_ts + jb->depth_ns;
+	if (due_ts < local_ts) {
+		jb->late++;
+		due_ts = local_ts;
+	}
+
+	if (jb->count == JITTER_BUFFER_CAPACITY) {
+		dropped = jb->frames[jb->first];
+		jb->frames[jb->first] = nullptr;
+		jb->first = (jb->first + 1) % JITTER_BUFFER_CAPACITY;
+		jb->count--;
+		jb->dropped++;
+	}
+
+	uint32_t index = (jb->first + jb->count) % JITTER_BUFFER_CAPACITY;
+	jb->frames[index] = frame;
+	jb->due_ts[index] = due_ts;
+	jb->count++;
+
+	pthread_mutex_unlock(&jb->mutex);
+
+	frame_pool_release(jb->pool, dropped);
+}
+
+uint64_t jitter_buffer_audio_due(struct jitter_buffer* jb,
+	int64_t ndi_timestamp, uint64_t local_ts)
+{
+	uint64_t nominal_ts = local_ts;
+	if (ndi_timestamp != NDIlib_recv_timestamp_undefined) {
+		nominal_ts = clock_mapper_map(jb->clock, CLOCK_MAPPER_AUDIO,
+			ndi_timestamp * 100, local_ts);
+	}
+
+	// OBS doesn't realign unbuffered video with audio: audio is delayed
+	// by the depth the video frames are due at
+	pthread_mutex_lock(&jb->mutex);
+	uint64_t due_ts = nominal_ts + jb->depth_ns;
+	pthread_mutex_unlock(&jb->mutex);
+
+	return due_ts;
+}
+
+struct obs_source_frame* jitter_buffer_pop(struct jitter_buffer* jb,
+	uint64_t now)
+{
+	struct obs_source_frame* frame = nullptr;
+
+	pthread_mutex_lock(&jb->mutex);
+
+	while (jb->count > 0 && jb->due_ts[jb->first] <= now) {
+		if (frame) {
+			frame_pool_release(jb->pool, frame);
+			jb->dropped++;
+		}
+
+		frame = jb->frames[jb->first];
+		frame->timestamp = jb->due_ts[jb->first];
+		jb->frames[jb->first] = nullptr;
+		jb->first = (jb->first + 1) % JITTER_BUFFER_CAPACITY;
+		jb->count--;
+	}
+
+	pthread_mutex_unlock(&jb->mutex);
+	return frame;
+}
+
+void jitter_buffer_get_stats(struct jitter_buffer* jb,
+	struct jitter_buffer_stats* stats)
+{
+	pthread_mutex_lock(&jb->mutex);
+	stats->depth_ms = (uint32_t)(jb->depth_ns / 1000000ULL);
+	stats->queued = jb->count;
+	stats->late = jb->late;
+	stats->dropped = jb->dropped;
+	pthread_mutex_unlock(&jb->mutex);
+}
@@ -0,0 +1,95 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <obs.h>
+
+#include "clock-mapper.h"
+#include "frame-pool.h"
+
+#define JITTER_BUFFER_CAPACITY 16
+
+struct jitter_buffer_stats
+{
+	uint32_t depth_ms;
+	uint32_t queued;
+
+	// Frames arriving after the time they were due, and frames never
+	// output because the buffer overflowed or a newer frame was due
+	uint64_t late;
+	uint64_t dropped;
+};
+
+// Receive-side video jitter buffer. Each frame is due at its nominal
+// arrival time (the sender timestamp, mapped to the local clock along the
+// least delayed arrivals) plus the buffer's depth. The depth follows the
+// peak delay of recent arrivals past their nominal time, up to a maximum,
+// so frames come out on the sender's cadence despite network jitter.
+// Audio isn't queued, but is timestamped to play with the same delay.
+struct jitter_buffer
+{
+	pthread_mutex_t mutex;
+	struct clock_mapper* clock;
+	struct frame_pool* pool;
+
+	struct obs_source_frame* frames[JITTER_BUFFER_CAPACITY];
+	uint64_t due_ts[JITTER_BUFFER_CAPACITY];
+	uint32_t first;
+	uint32_t count;
+
+	uint64_t max_depth_ns;
+	double peak_delay_ns;
+	uint64_t depth_ns;
+
+	uint64_t late;
+	uint64_t dropped;
+};
+
+// Queued frames come from pool, and are given back to it once dropped.
+// Sender timestamps are mapped with clock, shared with the source's other
+// uses so that audio and video follow the same clock model.
+void jitter_buffer_init(struct jitter_buffer* jb, struct clock_mapper* clock,
+	struct frame_pool* pool);
+void jitter_buffer_free(struct jitter_buffer* jb);
+
+// Drops all queued frames and restarts the depth estimation. The clock
+// mapper is left to its owner to reset.
+void jitter_buffer_clear(struct jitter_buffer* jb);
+
+void jitter_buffer_set_max_depth(struct jitter_buffer* jb, uint32_t max_ms);
+
+// Queues frame, taken from the pool, sent at ndi_timestamp (in 100 ns
+// units) and received at local_ts
+void jitter_buffer_push(struct jitter_buffer* jb,
+	struct obs_source_frame* frame, int64_t ndi_timestamp,
+	uint64_t local_ts);
+
+// Returns the time audio sent at ndi_timestamp (in 100 ns units) and
+// received at local_ts must play at to stay in sync with the video frames
+// output by the buffer
+uint64_t jitter_buffer_audio_due(struct jitter_buffer* jb,
+	int64_t ndi_timestamp, uint64_t local_ts);
+
+// Returns the most recent frame due at now, if any, dropping older ones.
+// It must be given back with frame_pool_release once output.
+struct obs_source_frame* jitter_buffer_pop(struct jitter_buffer* jb,
+	uint64_t now);
+
+void jitter_buffer_get_stats(struct jitter_buffer* jb,
+	struct jitter_buffer_stats* stats);
@@ -0,0 +1,155 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <obs-module.h>
+#include <util/threading.h>
+
+#include "obs-ndi.h"
+#include "ndi-discovery.h"
+
+// Upper bound on the time taken to stop discovery
+#define DISCOVERY_WAIT_TIMEOUT_MS 500
+
+static struct {
+	NDIlib_find_instance_t finder;
+	pthread_t thread;
+	bool thread_started;
+	volatile bool running;
+
+	// Held only to swap or reference the snapshot
+	pthread_mutex_t mutex;
+	struct ndi_discovery_snapshot* snapshot;
+} discovery;
+
+static int compare_names(const void* a, const void* b)
+{
+	return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+// One allocation: the name pointers, followed by the names themselves
+static struct ndi_discovery_snapshot* build_snapshot(
+	const NDIlib_source_t* ndi_sources, uint32_t count)
+{
+	size_t names_size = 0;
+	for (uint32_t i = 0; i < count; ++i)
+		names_size += strlen(ndi_sources[i].p_ndi_name) + 1;
+
+	auto snapshot = (struct ndi_discovery_snapshot*)bzalloc(
+		sizeof(struct ndi_discovery_snapshot) +
+		count * sizeof(char*) + names_size);
+	snapshot->refs = 1;
+	snapshot->count = count;
+	snapshot->names = (char**)(snapshot + 1);
+
+	char* name = (char*)(snapshot->names + count);
+	for (uint32_t i = 0; i < count; ++i) {
+		size_t size = strlen(ndi_sources[i].p_ndi_name) + 1;
+		memcpy(name, ndi_sources[i].p_ndi_name, size);
+		snapshot->names[i] = name;
+		name += size;
+	}
+
+	qsort(snapshot->names, count, sizeof(char*), compare_names);
+	return snapshot;
+}
+
+static void publish_snapshot(struct ndi_discovery_snapshot* snapshot)
+{
+	pthread_mutex_lock(&discovery.mutex);
+	struct ndi_discovery_snapshot* previous = discovery.snapshot;
+	discovery.snapshot = snapshot;
+	pthread_mutex_unlock(&discovery.mutex);
+
+	ndi_discovery_snapshot_release(previous);
+}
+
+static void* ndi_discovery_thread(void* data)
+{
+	UNUSED_PARAMETER(data);
+	os_set_thread_name("obs-ndi: discovery");
+
+	while (os_atomic_load_bool(&discovery.running)) {
+		if (!ndiLib->NDIlib_find_wait_for_sources(discovery.finder,
+			DISCOVERY_WAIT_TIMEOUT_MS))
+		{
+			continue;
+		}
+
+		uint32_t count = 0;
+		const NDIlib_source_t* ndi_sources =
+			ndiLib->NDIlib_find_get_current_sources(discovery.finder, &count);
+
+		publish_snapshot(build_snapshot(ndi_sources, count));
+		blog(LOG_DEBUG, "discovery: %u NDI sources", count);
+	}
+
+	return nullptr;
+}
+
+void ndi_discovery_start()
+{
+	NDIlib_find_create_t find_desc = {0};
+	find_desc.show_local_sources = true;
+	find_desc.p_groups = NULL;
+	discovery.finder = ndiLib->NDIlib_find_create_v2(&find_desc);
+
+	pthread_mutex_init(&discovery.mutex, NULL);
+	discovery.snapshot = build_snapshot(nullptr, 0);
+
+	os_atomic_set_bool(&discovery.running, true);
+	discovery.thread_started = pthread_create(&discovery.thread, nullptr,
+		ndi_discovery_thread, nullptr) == 0;
+	if (!discovery.thread_started) {
+		blog(LOG_ERROR, "can't start the NDI discovery thread");
+		os_atomic_set_bool(&discovery.running, false);
+	}
+}
+
+void ndi_discovery_stop()
+{
+	if (discovery.thread_started) {
+		os_atomic_set_bool(&discovery.running, false);
+		pthread_join(discovery.thread, nullptr);
+		discovery.thread_started = false;
+	}
+
+	ndiLib->NDIlib_find_destroy(discovery.finder);
+	discovery.finder = nullptr;
+
+	publish_snapshot(nullptr);
+	pthread_mutex_destroy(&discovery.mutex);
+}
+
+struct ndi_discovery_snapshot* ndi_discovery_get_snapshot()
+{
+	pthread_mutex_lock(&discovery.mutex);
+	struct ndi_discovery_snapshot* snapshot = discovery.snapshot;
+	if (snapshot)
+		os_atomic_inc_long(&snapshot->refs);
+	pthread_mutex_unlock(&discovery.mutex);
+	return snapshot;
+}
+
+void ndi_discovery_snapshot_release(struct ndi_discovery_snapshot* snapshot)
+{
+	if (snapshot && os_atomic_dec_long(&snapshot->refs) == 0)
+		bfree(snapshot);
+}
@@ -0,0 +1,41 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+// Immutable once published: readers can keep using a snapshot for as long
+// as they hold a reference, whatever the discovery thread does meanwhile.
+struct ndi_discovery_snapshot
+{
+	volatile long refs;
+
+	// Sorted
+	size_t count;
+	char** names;
+};
+
+// Runs NDI source discovery on a background thread
+void ndi_discovery_start();
+void ndi_discovery_stop();
+
+// Never waits on discovery. Returns the latest source list, to give back
+// with ndi_discovery_snapshot_release, or null until discovery starts.
+struct ndi_discovery_snapshot* ndi_discovery_get_snapshot();
+void ndi_discovery_snapshot_release(struct ndi_discovery_snapshot* snapshot);
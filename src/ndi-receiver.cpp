@@ -0,0 +1,917 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#include "obs-ndi.h"
+#include "ndi-receiver.h"
+
+// Capture timeouts. Captures return as soon as a frame or a status change
+// comes in, so these only bound how long stopping a receiver can take when
+// its sender goes silent.
+#define CAPTURE_TIMEOUT_MS 100
+#define AUDIO_CAPTURE_TIMEOUT_MS 20
+
+// Wait between two captures returning at once while not connected
+#define DISCONNECTED_RETRY_MS 10
+
+// How long a subscriber switching to a new receiver stays on its current
+// one, waiting for the new one to start receiving
+#define SWITCH_TIMEOUT_MS 1000
+
+struct ndi_receiver_subscriber
+{
+	void* param;
+	ndi_receiver_video_cb on_video;
+	ndi_receiver_audio_cb on_audio;
+
+	// Guards receiver and tally
+	pthread_mutex_t mutex;
+	struct ndi_receiver* receiver;
+	NDIlib_tally_t tally;
+	bool hw_accel;
+
+	// Last requested config, and whether it still waits for the worker.
+	// Guarded by the registry's queue mutex.
+	struct ndi_receiver_config config;
+	bool connect_pending;
+	struct ndi_receiver_subscriber* next_pending;
+
+	// In the receiver's subscriber list
+	struct ndi_receiver_subscriber* next;
+};
+
+struct ndi_receiver
+{
+	// Changed by retargeting, under the subscribers lock: the capture
+	// threads only read it with the lock held
+	char* ndi_name;
+	NDIlib_recv_bandwidth_e bandwidth;
+	bool framesync_enabled;
+	long refs;
+
+	NDIlib_recv_instance_t ndi_receiver;
+	NDIlib_framesync_instance_t ndi_framesync;
+
+	// Read-locked by the capture threads while delivering frames
+	pthread_rwlock_t subscribers_lock;
+	struct ndi_receiver_subscriber* subscribers;
+	bool hw_accel_enabled;
+	volatile bool video_enabled;
+	volatile long frames_received;
+
+	// Local time of the last (re)connection, and whether a frame came in
+	// since
+	uint64_t connect_ts;
+	volatile bool first_frame_received;
+
+	pthread_t video_thread;
+	pthread_t audio_thread;
+	bool running;
+
+	// Wake the capture threads up when stopping, and the video thread
+	// when video is resumed
+	os_event_t* stop_event;
+	os_event_t* video_resume_event;
+
+	struct ndi_receiver* next;
+};
+
+// All receiver creation, retargeting and refcounting is done under the
+// registry mutex, by the worker or while destroying a subscriber. Callers
+// only ever hold the queue mutex, which is never held for long.
+static struct {
+	pthread_mutex_t mutex;
+	struct ndi_receiver* receivers;
+
+	pthread_mutex_t queue_mutex;
+	struct ndi_receiver_subscriber* pending;
+	struct ndi_receiver* dead;
+
+	pthread_t worker;
+	os_sem_t* worker_sem;
+	bool worker_running;
+
+	// Subscriber the worker is switching to a new receiver, with the
+	// registry mutex released. Cleared if it gets destroyed meanwhile.
+	struct ndi_receiver_subscriber* switching;
+} registry;
+
+#ifdef _WIN32
+static void set_thread_realtime_priority()
+{
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+}
+#else
+static void set_thread_realtime_priority()
+{
+	struct sched_param param = {};
+	param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+
+	// Usually requires privileges: fall back to the default scheduling
+	if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+		blog(LOG_DEBUG, "can't raise audio capture thread priority");
+	}
+}
+#endif
+
+// Drops the video frames queued while video was suspended, but the last
+// one, so that resuming starts from the most recent frame
+static void ndi_receiver_skip_queued_video(struct ndi_receiver* r)
+{
+	NDIlib_recv_queue_t queue;
+	ndiLib->NDIlib_recv_get_queue(r->ndi_receiver, &queue);
+
+	NDIlib_video_frame_v2_t video_frame;
+	for (int i = 1; i < queue.video_frames; ++i) {
+		if (ndiLib->NDIlib_recv_capture_v2(r->ndi_receiver, &video_frame,
+			nullptr, nullptr, 0) != NDIlib_frame_type_video)
+			break;
+
+		ndiLib->NDIlib_recv_free_video_v2(r->ndi_receiver, &video_frame);
+	}
+}
+
+// Without any connection, the SDK may return from a capture at once rather
+// than wait for the timeout: rather than spin, wait a little, unless the
+// receiver is being stopped
+static void ndi_receiver_backoff(struct ndi_receiver* r,
+	uint64_t capture_start_ns)
+{
+	if (os_gettime_ns() - capture_start_ns < 1000000ULL) {
+		os_event_timedwait(r->stop_event, DISCONNECTED_RETRY_MS);
+	}
+}
+
+static void ndi_receiver_frame_received(struct ndi_receiver* r,
+	uint64_t local_ts)
+{
+	os_atomic_inc_long(&r->frames_received);
+
+	// Once per connection. The name and connect time change with
+	// retargeting.
+	if (!os_atomic_set_bool(&r->first_frame_received, true)) {
+		pthread_rwlock_rdlock(&r->subscribers_lock);
+		blog(LOG_INFO, "first frame from '%s' %.1f ms after connecting",
+			r->ndi_name, (double)(local_ts - r->connect_ts) / 1000000.0);
+		pthread_rwlock_unlock(&r->subscribers_lock);
+	}
+}
+
+static void ndi_receiver_log_thread(struct ndi_receiver* r,
+	const char* thread, const char* event)
+{
+	pthread_rwlock_rdlock(&r->subscribers_lock);
+	blog(LOG_INFO, "%s thread for '%s' %s", thread, r->ndi_name, event);
+	pthread_rwlock_unlock(&r->subscribers_lock);
+}
+
+static void* ndi_receiver_video_thread(void* data)
+{
+	auto r = (struct ndi_receiver*)data;
+
+	ndi_receiver_log_thread(r, "video", "started");
+
+	NDIlib_video_frame_v2_t video_frame;
+
+	os_performance_token_t* perf_token =
+		os_request_high_performance("NDI Receiver Thread");
+
+	bool was_enabled = true;
+	NDIlib_frame_type_e frame_received = NDIlib_frame_type_none;
+	while (r->running) {
+		// Video frames aren't decoded until they are captured
+		const bool video_enabled = os_atomic_load_bool(&r->video_enabled);
+		if (!video_enabled) {
+			was_enabled = false;
+			os_event_wait(r->video_resume_event);
+			continue;
+		}
+
+		if (!was_enabled) {
+			ndi_receiver_skip_queued_video(r);
+			was_enabled = true;
+		}
+
+		uint64_t capture_start = os_gettime_ns();
+		frame_received = ndiLib->NDIlib_recv_capture_v2(r->ndi_receiver,
+			&video_frame, nullptr, nullptr, CAPTURE_TIMEOUT_MS);
+
+		switch (frame_received) {
+			case NDIlib_frame_type_video: {
+				uint64_t local_ts = os_gettime_ns();
+				ndi_receiver_frame_received(r, local_ts);
+
+				pthread_rwlock_rdlock(&r->subscribers_lock);
+				for (auto sub = r->subscribers; sub; sub = sub->next) {
+					sub->on_video(sub->param, &video_frame, local_ts);
+				}
+				pthread_rwlock_unlock(&r->subscribers_lock);
+
+				ndiLib->NDIlib_recv_free_video_v2(r->ndi_receiver,
+					&video_frame);
+				break;
+			}
+
+			// Connected, disconnected or the sender changed its
+			// settings: capture again right away
+			case NDIlib_frame_type_status_change:
+				break;
+
+			default:
+				ndi_receiver_backoff(r, capture_start);
+				break;
+		}
+	}
+
+	os_end_high_performance(perf_token);
+
+	ndi_receiver_log_thread(r, "video", "completed");
+	return nullptr;
+}
+
+// Audio has its own thread, at real-time priority, so that it never waits
+// on video frames being copied into OBS
+static void* ndi_receiver_audio_thread(void* data)
+{
+	auto r = (struct ndi_receiver*)data;
+
+	ndi_receiver_log_thread(r, "audio", "started");
+	set_thread_realtime_priority();
+
+	NDIlib_audio_frame_v2_t audio_frame;
+
+	NDIlib_frame_type_e frame_received = NDIlib_frame_type_none;
+	while (r->running) {
+		uint64_t capture_start = os_gettime_ns();
+		frame_received = ndiLib->NDIlib_recv_capture_v2(r->ndi_receiver,
+			nullptr, &audio_frame, nullptr, AUDIO_CAPTURE_TIMEOUT_MS);
+
+		switch (frame_received) {
+			case NDIlib_frame_type_audio: {
+				uint64_t local_ts = os_gettime_ns();
+				ndi_receiver_frame_received(r, local_ts);
+
+				pthread_rwlock_rdlock(&r->subscribers_lock);
+				for (auto sub = r->subscribers; sub; sub = sub->next) {
+					sub->on_audio(sub->param, &audio_frame, local_ts);
+				}
+				pthread_rwlock_unlock(&r->subscribers_lock);
+
+				ndiLib->NDIlib_recv_free_audio_v2(r->ndi_receiver,
+					&audio_frame);
+				break;
+			}
+
+			case NDIlib_frame_type_status_change:
+				break;
+
+			default:
+				ndi_receiver_backoff(r, capture_start);
+				break;
+		}
+	}
+
+	ndi_receiver_log_thread(r, "audio", "completed");
+	return nullptr;
+}
+
+static void* ndi_receiver_framesync_audio_thread(void* data)
+{
+	auto r = (struct ndi_receiver*)data;
+
+	ndi_receiver_log_thread(r, "framesync audio", "started");
+
+	struct obs_audio_info oai;
+	obs_get_audio_info(&oai);
+
+	// Audio is pulled from the frame-synchronizer at OBS's own rate and
+	// layout, one OBS audio frame at a time, paced by the local clock.
+	const int sample_rate = (int)oai.samples_per_sec;
+	const int no_channels = (int)get_audio_channels(oai.speakers);
+	const int no_samples = AUDIO_OUTPUT_FRAMES;
+	const uint64_t interval_ns =
+		(uint64_t)no_samples * 1000000000ULL / (uint64_t)sample_rate;
+
+	NDIlib_audio_frame_v2_t audio_frame;
+
+	set_thread_realtime_priority();
+	os_performance_token_t* perf_token =
+		os_request_high_performance("NDI Receiver Thread");
+
+	uint64_t next_ts = os_gettime_ns();
+	while (r->running) {
+		if (ndiLib->NDIlib_recv_get_no_connections(r->ndi_receiver) > 0) {
+			ndiLib->NDIlib_framesync_capture_audio(r->ndi_framesync,
+				&audio_frame, sample_rate, no_channels, no_samples);
+
+			pthread_rwlock_rdlock(&r->subscribers_lock);
+			for (auto sub = r->subscribers; sub; sub = sub->next) {
+				sub->on_audio(sub->param, &audio_frame, next_ts);
+			}
+			pthread_rwlock_unlock(&r->subscribers_lock);
+
+			ndiLib->NDIlib_framesync_free_audio(r->ndi_framesync,
+				&audio_frame);
+		}
+
+		next_ts += interval_ns;
+		if (!os_sleepto_ns(next_ts)) {
+			// We fell behind (or were suspended): resync on the clock
+			next_ts = os_gettime_ns();
+		}
+	}
+
+	os_end_high_performance(perf_token);
+
+	ndi_receiver_log_thread(r, "framesync audio", "completed");
+	return nullptr;
+}
+
+static struct ndi_receiver* ndi_receiver_create(
+	const struct ndi_receiver_config* config)
+{
+	NDIlib_recv_create_v3_t recv_desc;
+	recv_desc.source_to_connect_to.p_ndi_name = config->ndi_name;
+	recv_desc.allow_video_fields = true;
+#if LIBOBS_API_VER >= MAKE_SEMANTIC_VERSION(26, 1, 0)
+	// Sources with alpha arrive as UYVA, which the subscribers output as
+	// I42A instead of having the SDK expand them to BGRA
+	recv_desc.color_format = NDIlib_recv_color_format_fastest;
+#else
+	recv_desc.color_format = NDIlib_recv_color_format_UYVY_BGRA;
+#endif
+	recv_desc.bandwidth = config->bandwidth;
+
+	NDIlib_recv_instance_t ndi_receiver =
+		ndiLib->NDIlib_recv_create_v3(&recv_desc);
+	if (!ndi_receiver) {
+		blog(LOG_ERROR, "can't create a receiver for NDI source '%s'",
+			config->ndi_name);
+		return nullptr;
+	}
+
+	auto r = (struct ndi_receiver*)bzalloc(sizeof(struct ndi_receiver));
+	r->ndi_name = bstrdup(config->ndi_name);
+	r->bandwidth = config->bandwidth;
+	r->framesync_enabled = config->framesync;
+	r->ndi_receiver = ndi_receiver;
+	pthread_rwlock_init(&r->subscribers_lock, NULL);
+
+	if (r->framesync_enabled) {
+		r->ndi_framesync = ndiLib->NDIlib_framesync_create(r->ndi_receiver);
+	}
+
+	os_event_init(&r->stop_event, OS_EVENT_TYPE_MANUAL);
+	os_event_init(&r->video_resume_event, OS_EVENT_TYPE_AUTO);
+	r->connect_ts = os_gettime_ns();
+
+	// Video from a frame-synchronizer is pulled by the subscribers
+	r->running = true;
+	if (r->ndi_framesync) {
+		pthread_create(&r->audio_thread, nullptr,
+			ndi_receiver_framesync_audio_thread, r);
+	} else {
+		pthread_create(&r->audio_thread, nullptr,
+			ndi_receiver_audio_thread, r);
+		pthread_create(&r->video_thread, nullptr,
+			ndi_receiver_video_thread, r);
+	}
+
+	blog(LOG_INFO, "started A/V threads for source '%s'", r->ndi_name);
+	return r;
+}
+
+static void ndi_receiver_destroy(struct ndi_receiver* r)
+{
+	const uint64_t stop_start = os_gettime_ns();
+
+	r->running = false;
+	os_event_signal(r->stop_event);
+	os_event_signal(r->video_resume_event);
+
+	// Captures can't be cancelled: disconnecting makes pending ones return
+	// with a status change, or else they time out
+	ndiLib->NDIlib_recv_connect(r->ndi_receiver, nullptr);
+
+	pthread_join(r->audio_thread, NULL);
+	if (!r->ndi_framesync) {
+		pthread_join(r->video_thread, NULL);
+	}
+
+	blog(LOG_INFO, "receiver for '%s' stopped in %.1f ms", r->ndi_name,
+		(double)(os_gettime_ns() - stop_start) / 1000000.0);
+
+	os_event_destroy(r->video_resume_event);
+	os_event_destroy(r->stop_event);
+
+	if (r->ndi_framesync) {
+		ndiLib->NDIlib_framesync_destroy(r->ndi_framesync);
+	}
+	ndiLib->NDIlib_recv_destroy(r->ndi_receiver);
+
+	pthread_rwlock_destroy(&r->subscribers_lock);
+	bfree(r->ndi_name);
+	bfree(r);
+}
+
+static void ndi_receiver_destroy_list(struct ndi_receiver* r)
+{
+	while (r) {
+		struct ndi_receiver* next = r->next;
+		ndi_receiver_destroy(r);
+		r = next;
+	}
+}
+
+// Must be called with the subscribers lock held for writing. Video is only
+// decoded while at least one subscriber is shown or active.
+static void ndi_receiver_apply_tally(struct ndi_receiver* r)
+{
+	NDIlib_tally_t tally;
+	tally.on_preview = false;
+	tally.on_program = false;
+
+	for (auto sub = r->subscribers; sub; sub = sub->next) {
+		tally.on_preview |= sub->tally.on_preview;
+		tally.on_program |= sub->tally.on_program;
+	}
+
+	ndiLib->NDIlib_recv_set_tally(r->ndi_receiver, &tally);
+
+	const bool video_enabled = tally.on_preview || tally.on_program;
+	if (os_atomic_set_bool(&r->video_enabled, video_enabled) !=
+		video_enabled)
+	{
+		blog(LOG_DEBUG, "%s video decoding for '%s'",
+			video_enabled ? "resuming" : "suspending", r->ndi_name);
+
+		if (video_enabled) {
+			os_event_signal(r->video_resume_event);
+		}
+	}
+}
+
+// Must be called with the subscribers lock held for writing
+static void ndi_receiver_apply_hw_accel(struct ndi_receiver* r, bool force)
+{
+	bool hw_accel = false;
+	for (auto sub = r->subscribers; sub; sub = sub->next) {
+		hw_accel |= sub->hw_accel;
+	}
+
+	// Can't be turned off once requested: the sender will only forget
+	// about it on reconnection
+	if (hw_accel && (force || !r->hw_accel_enabled)) {
+		NDIlib_metadata_frame_t hwAccelMetadata;
+		hwAccelMetadata.p_data = (char*)"<ndi_hwaccel enabled=\"true\"/>";
+		ndiLib->NDIlib_recv_send_metadata(r->ndi_receiver, &hwAccelMetadata);
+		r->hw_accel_enabled = true;
+	}
+}
+
+static bool ndi_receiver_matches(struct ndi_receiver* r,
+	const struct ndi_receiver_config* config)
+{
+	return strcmp(r->ndi_name, config->ndi_name) == 0 &&
+		r->bandwidth == config->bandwidth &&
+		r->framesync_enabled == config->framesync;
+}
+
+// Must be called with the registry mutex held. Receivers left without
+// subscribers are moved to *dead, to be destroyed once the mutex is
+// released.
+static void ndi_receiver_release(struct ndi_receiver* receiver,
+	struct ndi_receiver** dead)
+{
+	if (--receiver->refs > 0)
+		return;
+
+	for (auto r = &registry.receivers; *r; r = &(*r)->next) {
+		if (*r == receiver) {
+			*r = receiver->next;
+			break;
+		}
+	}
+
+	receiver->next = *dead;
+	*dead = receiver;
+}
+
+// Must be called with the registry mutex held
+static void ndi_receiver_detach(struct ndi_receiver_subscriber* sub,
+	struct ndi_receiver** dead)
+{
+	pthread_mutex_lock(&sub->mutex);
+	struct ndi_receiver* r = sub->receiver;
+	if (r) {
+		pthread_rwlock_wrlock(&r->subscribers_lock);
+		for (auto it = &r->subscribers; *it; it = &(*it)->next) {
+			if (*it == sub) {
+				*it = sub->next;
+				break;
+			}
+		}
+		sub->next = nullptr;
+		ndi_receiver_apply_tally(r);
+		pthread_rwlock_unlock(&r->subscribers_lock);
+	}
+	sub->receiver = nullptr;
+	pthread_mutex_unlock(&sub->mutex);
+
+	if (r) {
+		ndi_receiver_release(r, dead);
+	}
+}
+
+// Must be called with the registry mutex held
+static void ndi_receiver_attach(struct ndi_receiver_subscriber* sub,
+	struct ndi_receiver* r)
+{
+	r->refs++;
+
+	pthread_mutex_lock(&sub->mutex);
+	pthread_rwlock_wrlock(&r->subscribers_lock);
+	sub->next = r->subscribers;
+	r->subscribers = sub;
+	ndi_receiver_apply_hw_accel(r, false);
+	ndi_receiver_apply_tally(r);
+	pthread_rwlock_unlock(&r->subscribers_lock);
+	sub->receiver = r;
+	pthread_mutex_unlock(&sub->mutex);
+}
+
+static void ndi_receiver_wait_started(struct ndi_receiver* r,
+	uint32_t timeout_ms)
+{
+	const uint64_t deadline =
+		os_gettime_ns() + (uint64_t)timeout_ms * 1000000ULL;
+
+	while (os_gettime_ns() < deadline) {
+		// Frame-synchronizers output frames whether or not anything was
+		// received: the best we can do is to wait for a connection
+		if (r->ndi_framesync) {
+			if (ndiLib->NDIlib_recv_get_no_connections(r->ndi_receiver) > 0)
+				return;
+		} else if (os_atomic_load_long(&r->frames_received) > 0) {
+			return;
+		}
+
+		os_sleep_ms(10);
+	}
+}
+
+// Must be called with the registry mutex held. It is released while
+// waiting for a new receiver to start, and the subscriber may then be
+// destroyed: registry.switching tells.
+static void ndi_receiver_process_connect(struct ndi_receiver_subscriber* sub,
+	const struct ndi_receiver_config* config, struct ndi_receiver** dead)
+{
+	struct ndi_receiver* current = sub->receiver;
+
+	if (current && ndi_receiver_matches(current, config)) {
+		pthread_rwlock_wrlock(&current->subscribers_lock);
+		sub->hw_accel = config->hw_accel;
+		ndi_receiver_apply_hw_accel(current, false);
+		pthread_rwlock_unlock(&current->subscribers_lock);
+		return;
+	}
+
+	struct ndi_receiver* r = registry.receivers;
+	for (; r; r = r->next) {
+		if (ndi_receiver_matches(r, config))
+			break;
+	}
+
+	// Nobody else uses our receiver and only the NDI source changes: keep
+	// the receiver and its threads, and just point it elsewhere
+	if (!r && current && current->refs == 1 &&
+		current->bandwidth == config->bandwidth &&
+		current->framesync_enabled == config->framesync)
+	{
+		blog(LOG_INFO, "reconnecting receiver from '%s' to '%s'",
+			current->ndi_name, config->ndi_name);
+
+		// Renamed before connecting, so that frames from the new source
+		// are never reported under a freed name
+		char* previous_name = current->ndi_name;
+		pthread_rwlock_wrlock(&current->subscribers_lock);
+		current->ndi_name = bstrdup(config->ndi_name);
+		current->connect_ts = os_gettime_ns();
+		os_atomic_set_bool(&current->first_frame_received, false);
+		pthread_rwlock_unlock(&current->subscribers_lock);
+		bfree(previous_name);
+
+		NDIlib_source_t source;
+		source.p_ndi_name = current->ndi_name;
+		ndiLib->NDIlib_recv_connect(current->ndi_receiver, &source);
+
+		pthread_rwlock_wrlock(&current->subscribers_lock);
+		sub->hw_accel = config->hw_accel;
+		ndi_receiver_apply_hw_accel(current, true);
+		ndi_receiver_apply_tally(current);
+		pthread_rwlock_unlock(&current->subscribers_lock);
+		return;
+	}
+
+	bool created = false;
+	if (!r) {
+		r = ndi_receiver_create(config);
+		if (r) {
+			r->next = registry.receivers;
+			registry.receivers = r;
+			created = true;
+		}
+	}
+
+	if (!r) {
+		ndi_receiver_detach(sub, dead);
+		return;
+	}
+
+	// Held by the worker until the subscriber is attached
+	r->refs++;
+
+	// Make before break: frames keep coming from the current receiver
+	// until the new one has started receiving. Only the worker switches
+	// subscribers, so the current receiver can't change meanwhile.
+	if (created && current) {
+		registry.switching = sub;
+		pthread_mutex_unlock(&registry.mutex);
+
+		ndi_receiver_wait_started(r, SWITCH_TIMEOUT_MS);
+
+		pthread_mutex_lock(&registry.mutex);
+		bool destroyed = (registry.switching != sub);
+		registry.switching = nullptr;
+
+		if (destroyed) {
+			ndi_receiver_release(r, dead);
+			return;
+		}
+	}
+
+	ndi_receiver_detach(sub, dead);
+
+	sub->hw_accel = config->hw_accel;
+	ndi_receiver_attach(sub, r);
+	ndi_receiver_release(r, dead);
+}
+
+static void* ndi_receiver_worker_thread(void* data)
+{
+	UNUSED_PARAMETER(data);
+
+	while (os_sem_wait(registry.worker_sem) == 0) {
+		struct ndi_receiver* dead = nullptr;
+
+		pthread_mutex_lock(&registry.mutex);
+		pthread_mutex_lock(&registry.queue_mutex);
+
+		if (!registry.worker_running && !registry.pending &&
+			!registry.dead)
+		{
+			pthread_mutex_unlock(&registry.queue_mutex);
+			pthread_mutex_unlock(&registry.mutex);
+			break;
+		}
+
+		dead = registry.dead;
+		registry.dead = nullptr;
+
+		struct ndi_receiver_subscriber* sub = registry.pending;
+		struct ndi_receiver_config config = {};
+		if (sub) {
+			registry.pending = sub->next_pending;
+			sub->next_pending = nullptr;
+			sub->connect_pending = false;
+
+			config = sub->config;
+			config.ndi_name = bstrdup(sub->config.ndi_name);
+		}
+
+		pthread_mutex_unlock(&registry.queue_mutex);
+
+		if (sub) {
+			ndi_receiver_process_connect(sub, &config, &dead);
+		}
+
+		pthread_mutex_unlock(&registry.mutex);
+
+		// Joining receiver threads happens here and nowhere else
+		ndi_receiver_destroy_list(dead);
+		bfree((void*)config.ndi_name);
+	}
+
+	return nullptr;
+}
+
+void ndi_receiver_registry_init()
+{
+	pthread_mutex_init(&registry.mutex, NULL);
+	pthread_mutex_init(&registry.queue_mutex, NULL);
+	registry.receivers = nullptr;
+	registry.switching = nullptr;
+	registry.pending = nullptr;
+	registry.dead = nullptr;
+
+	os_sem_init(&registry.worker_sem, 0);
+	registry.worker_running = true;
+	pthread_create(&registry.worker, nullptr,
+		ndi_receiver_worker_thread, nullptr);
+}
+
+void ndi_receiver_registry_deinit()
+{
+	pthread_mutex_lock(&registry.queue_mutex);
+	registry.worker_running = false;
+	pthread_mutex_unlock(&registry.queue_mutex);
+
+	os_sem_post(registry.worker_sem);
+	pthread_join(registry.worker, NULL);
+	os_sem_destroy(registry.worker_sem);
+
+	if (registry.receivers) {
+		blog(LOG_WARNING, "receivers still in use at shutdown");
+	}
+	pthread_mutex_destroy(&registry.queue_mutex);
+	pthread_mutex_destroy(&registry.mutex);
+}
+
+struct ndi_receiver_subscriber* ndi_receiver_subscriber_create(void* param,
+	ndi_receiver_video_cb on_video, ndi_receiver_audio_cb on_audio)
+{
+	auto sub = (struct ndi_receiver_subscriber*)bzalloc(
+		sizeof(struct ndi_receiver_subscriber));
+	sub->param = param;
+	sub->on_video = on_video;
+	sub->on_audio = on_audio;
+	pthread_mutex_init(&sub->mutex, NULL);
+	return sub;
+}
+
+void ndi_receiver_subscriber_destroy(struct ndi_receiver_subscriber* sub)
+{
+	if (!sub)
+		return;
+
+	struct ndi_receiver* dead = nullptr;
+
+	// Waits for the worker to be done with any request, except for a
+	// switch to a new receiver, which it will give up
+	pthread_mutex_lock(&registry.mutex);
+
+	pthread_mutex_lock(&registry.queue_mutex);
+	for (auto it = &registry.pending; *it; it = &(*it)->next_pending) {
+		if (*it == sub) {
+			*it = sub->next_pending;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&registry.queue_mutex);
+
+	if (registry.switching == sub) {
+		registry.switching = nullptr;
+	}
+
+	ndi_receiver_detach(sub, &dead);
+
+	pthread_mutex_unlock(&registry.mutex);
+
+	if (dead) {
+		pthread_mutex_lock(&registry.queue_mutex);
+		while (dead) {
+			struct ndi_receiver* next = dead->next;
+			dead->next = registry.dead;
+			registry.dead = dead;
+			dead = next;
+		}
+		pthread_mutex_unlock(&registry.queue_mutex);
+		os_sem_post(registry.worker_sem);
+	}
+
+	bfree((void*)sub->config.ndi_name);
+	pthread_mutex_destroy(&sub->mutex);
+	bfree(sub);
+}
+
+void ndi_receiver_connect(struct ndi_receiver_subscriber* sub,
+	const struct ndi_receiver_config* config)
+{
+	pthread_mutex_lock(&registry.queue_mutex);
+
+	const char* previous_name = sub->config.ndi_name;
+	if (previous_name && strcmp(previous_name, config->ndi_name) == 0 &&
+		sub->config.bandwidth == config->bandwidth &&
+		sub->config.framesync == config->framesync &&
+		sub->config.hw_accel == config->hw_accel)
+	{
+		pthread_mutex_unlock(&registry.queue_mutex);
+		return;
+	}
+
+	sub->config = *config;
+	sub->config.ndi_name = bstrdup(config->ndi_name);
+	bfree((void*)previous_name);
+
+	bool post = !sub->connect_pending;
+	if (post) {
+		sub->connect_pending = true;
+		sub->next_pending = registry.pending;
+		registry.pending = sub;
+	}
+
+	pthread_mutex_unlock(&registry.queue_mutex);
+
+	if (post) {
+		os_sem_post(registry.worker_sem);
+	}
+}
+
+void ndi_receiver_set_tally(struct ndi_receiver_subscriber* sub,
+	const NDIlib_tally_t* tally)
+{
+	pthread_mutex_lock(&sub->mutex);
+	sub->tally = *tally;
+	if (sub->receiver) {
+		pthread_rwlock_wrlock(&sub->receiver->subscribers_lock);
+		ndi_receiver_apply_tally(sub->receiver);
+		pthread_rwlock_unlock(&sub->receiver->subscribers_lock);
+	}
+	pthread_mutex_unlock(&sub->mutex);
+}
+
+bool ndi_receiver_get_stats(struct ndi_receiver_subscriber* sub,
+	struct ndi_receiver_stats* stats)
+{
+	pthread_mutex_lock(&sub->mutex);
+
+	struct ndi_receiver* r = sub->receiver;
+	if (r) {
+		NDIlib_recv_performance_t total, dropped;
+		ndiLib->NDIlib_recv_get_performance(r->ndi_receiver,
+			&total, &dropped);
+
+		NDIlib_recv_queue_t queue;
+		ndiLib->NDIlib_recv_get_queue(r->ndi_receiver, &queue);
+
+		stats->video_frames = total.video_frames;
+		stats->audio_frames = total.audio_frames;
+		stats->dropped_video_frames = dropped.video_frames;
+		stats->dropped_audio_frames = dropped.audio_frames;
+		stats->video_queue = queue.video_frames;
+		stats->audio_queue = queue.audio_frames;
+		stats->connections =
+			ndiLib->NDIlib_recv_get_no_connections(r->ndi_receiver);
+	}
+
+	pthread_mutex_unlock(&sub->mutex);
+	return r != nullptr;
+}
+
+void ndi_receiver_pull_framesync_video(struct ndi_receiver_subscriber* sub)
+{
+	pthread_mutex_lock(&sub->mutex);
+
+	struct ndi_receiver* r = sub->receiver;
+	if (r && r->ndi_framesync) {
+		// The frame-synchronizer repeats or drops frames as needed to
+		// follow the rate at which it is pulled from
+		NDIlib_video_frame_v2_t video_frame;
+		ndiLib->NDIlib_framesync_capture_video(r->ndi_framesync,
+			&video_frame, NDIlib_frame_format_type_progressive);
+
+		if (video_frame.p_data) {
+			sub->on_video(sub->param, &video_frame, os_gettime_ns());
+		}
+
+		ndiLib->NDIlib_framesync_free_video(r->ndi_framesync,
+			&video_frame);
+	}
+
+	pthread_mutex_unlock(&sub->mutex);
+}
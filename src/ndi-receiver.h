@@ -0,0 +1,96 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <Processing.NDI.Lib.h>
+
+// Shared NDI receivers. Every OBS source connecting to the same NDI source
+// with the same bandwidth (and capture mode) subscribes to one receiver,
+// which connects, captures and decodes once and hands each frame to every
+// subscriber. Receivers are refcounted by their subscribers.
+
+// Frame callbacks run on the receiver's threads, except for video pulled
+// with ndi_receiver_pull_framesync_video. local_ts is the local time (as
+// given by os_gettime_ns) the frame was captured at.
+typedef void (*ndi_receiver_video_cb)(void* param,
+	NDIlib_video_frame_v2_t* frame, uint64_t local_ts);
+typedef void (*ndi_receiver_audio_cb)(void* param,
+	NDIlib_audio_frame_v2_t* frame, uint64_t local_ts);
+
+struct ndi_receiver_config
+{
+	const char* ndi_name;
+	NDIlib_recv_bandwidth_e bandwidth;
+
+	// Bind a frame-synchronizer: video is then pulled by each subscriber
+	// and audio is pulled at OBS's own pace by the receiver
+	bool framesync;
+
+	bool hw_accel;
+};
+
+struct ndi_receiver_stats
+{
+	// Totals since the receiver was created
+	int64_t video_frames;
+	int64_t audio_frames;
+	int64_t dropped_video_frames;
+	int64_t dropped_audio_frames;
+
+	// Frames received but not captured yet
+	int video_queue;
+	int audio_queue;
+
+	int connections;
+};
+
+void ndi_receiver_registry_init();
+void ndi_receiver_registry_deinit();
+
+struct ndi_receiver_subscriber* ndi_receiver_subscriber_create(void* param,
+	ndi_receiver_video_cb on_video, ndi_receiver_audio_cb on_audio);
+
+// Once this returns, no callback of the subscriber is running or will run.
+// Never waits on a receiver thread: a receiver left without subscribers is
+// destroyed in the background.
+void ndi_receiver_subscriber_destroy(struct ndi_receiver_subscriber* sub);
+
+// Requests the subscriber to be moved to the receiver matching config and
+// returns immediately: the (re)connection is done by a background worker,
+// and a request superseded before it was processed is dropped. A receiver
+// used by this subscriber alone is retargeted with NDIlib_recv_connect
+// rather than torn down and recreated.
+void ndi_receiver_connect(struct ndi_receiver_subscriber* sub,
+	const struct ndi_receiver_config* config);
+
+// Applies the subscriber's tally. The receiver reports the combined tally
+// of all its subscribers to the sender, and stops decoding video while
+// none of them is shown or active. Audio keeps flowing.
+void ndi_receiver_set_tally(struct ndi_receiver_subscriber* sub,
+	const NDIlib_tally_t* tally);
+
+// Samples the counters of the receiver the subscriber is connected to.
+// Returns false if it isn't connected to any.
+bool ndi_receiver_get_stats(struct ndi_receiver_subscriber* sub,
+	struct ndi_receiver_stats* stats);
+
+// Frame-synchronized receivers only: pulls the current video frame and
+// passes it to the subscriber's video callback, on the calling thread.
+void ndi_receiver_pull_framesync_video(struct ndi_receiver_subscriber* sub);
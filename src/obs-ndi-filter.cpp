@@ -20,6 +20,8 @@ along with this program; If not, see <https://www.gnu.org/licenses/>
 #include <Windows.h>
 #endif
 
+#include <stdio.h>
+
 #include <obs-module.h>
 #include <obs-frontend-api.h>
 #include <util/platform.h>
@@ -27,35 +29,92 @@ along with this program; If not, see <https://www.gnu.org/licenses/>
 #include <media-io/video-io.h>
 #include <media-io/video-frame.h>
 #include <media-io/audio-resampler.h>
+#include <graphics/matrix4.h>
 
 #include "obs-ndi.h"
+#include "sender-handle.h"
+#include "audio-send-queue.h"
+#include "gpu-packing.h"
+#include "readback-ring.h"
+#include "readback-scheduler.h"
+#include "connection-monitor.h"
 
 #define TEXFORMAT GS_BGRA
 #define FLT_PROP_NAME "ndi_filter_ndiname"
+#define FLT_PROP_ASYNC_SEND "ndi_filter_async_send"
+#define FLT_PROP_READBACK_DEPTH "ndi_filter_readback_depth"
+#define FLT_PROP_PIXEL_FORMAT "ndi_filter_pixel_format"
+#define FLT_PROP_FRAME_DIVISOR "ndi_filter_frame_divisor"
+#define FLT_PROP_OUTPUT_SCALE "ndi_filter_output_scale"
+
+#define FLT_MAX_FRAME_DIVISOR 10
+
+#define FLT_PIXEL_FORMAT_BGRA 0
+#define FLT_PIXEL_FORMAT_UYVY 1
+#define FLT_PIXEL_FORMAT_UYVA 2
+
+// Video settings applied per frame by the render callback
+struct ndi_filter_video_config
+{
+	uint32_t readback_depth;
+	uint32_t pixel_format;
+
+	// Only every frame_divisor-th frame is rendered and sent, at
+	// output_scale percent of the parent's size
+	uint32_t frame_divisor;
+	uint32_t output_scale;
+};
 
 struct ndi_filter
 {
 	obs_source_t* context;
-	NDIlib_send_instance_t ndi_sender;
-	pthread_mutex_t	ndi_sender_video_mutex;
-	pthread_mutex_t ndi_sender_audio_mutex;
+	// Swapped by updates without blocking the video and audio sends
+	struct ndi_sender_slot sender;
+	struct ndi_connection_watch* connections;
+	struct audio_send_queue* audio_queue;
 	struct obs_video_info ovi;
 	struct obs_audio_info oai;
 
-	uint32_t known_width;
-	uint32_t known_height;
-
+	struct readback_client* readback_client;
 	gs_texrender_t* texrender;
-	gs_stagesurf_t* stagesurface;
-	uint8_t* video_data;
-	uint32_t video_linesize;
+	struct readback_ring readback;
+	uint32_t frame_count;
+
+	// Packed ndi_filter_video_config, swapped in one atomic store by
+	// ndi_filter_update and loaded once per frame by the render callback.
+	// The send workers get the frame divisor with each frame.
+	volatile long video_config;
+
+	// Packs frames to UYVY or UYVA on the GPU before readback
+	gs_effect_t* convert_effect;
+	gs_texrender_t* convert_texrender;
 
-	video_t* video_output;
 	bool is_audioonly;
 
 	os_performance_token_t* perf_token;
 };
 
+static long ndi_filter_pack_config(const struct ndi_filter_video_config* config)
+{
+	return (long)(config->readback_depth & 0xff) |
+		((long)(config->pixel_format & 0xff) << 8) |
+		((long)(config->frame_divisor & 0xff) << 16) |
+		((long)(config->output_scale & 0x7f) << 24);
+}
+
+static struct ndi_filter_video_config ndi_filter_load_config(
+	struct ndi_filter* s)
+{
+	long packed = os_atomic_load_long(&s->video_config);
+
+	struct ndi_filter_video_config config;
+	config.readback_depth = (uint32_t)(packed & 0xff);
+	config.pixel_format = (uint32_t)((packed >> 8) & 0xff);
+	config.frame_divisor = (uint32_t)((packed >> 16) & 0xff);
+	config.output_scale = (uint32_t)((packed >> 24) & 0x7f);
+	return config;
+}
+
 const char* ndi_filter_getname(void* data)
 {
 	UNUSED_PARAMETER(data);
@@ -80,6 +139,52 @@ obs_properties_t* ndi_filter_getproperties(void* data)
 	obs_properties_add_text(props, FLT_PROP_NAME,
 		obs_module_text("NDIPlugin.FilterProps.NDIName"), OBS_TEXT_DEFAULT);
 
+	if (!s || !s->is_audioonly) {
+		obs_properties_add_bool(props, FLT_PROP_ASYNC_SEND,
+			obs_module_text("NDIPlugin.FilterProps.AsyncSend"));
+
+		obs_property_t* depth = obs_properties_add_int(props,
+			FLT_PROP_READBACK_DEPTH,
+			obs_module_text("NDIPlugin.FilterProps.ReadbackDepth"),
+			0, READBACK_RING_MAX_DEPTH, 1);
+		obs_property_set_long_description(depth,
+			obs_module_text("NDIPlugin.FilterProps.ReadbackDepth.Description"));
+
+		obs_property_t* pixel_formats = obs_properties_add_list(props,
+			FLT_PROP_PIXEL_FORMAT,
+			obs_module_text("NDIPlugin.FilterProps.PixelFormat"),
+			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+		obs_property_list_add_int(pixel_formats,
+			obs_module_text("NDIPlugin.FilterProps.PixelFormat.BGRA"),
+			FLT_PIXEL_FORMAT_BGRA);
+		obs_property_list_add_int(pixel_formats,
+			obs_module_text("NDIPlugin.FilterProps.PixelFormat.UYVY"),
+			FLT_PIXEL_FORMAT_UYVY);
+		obs_property_list_add_int(pixel_formats,
+			obs_module_text("NDIPlugin.FilterProps.PixelFormat.UYVA"),
+			FLT_PIXEL_FORMAT_UYVA);
+		obs_property_set_long_description(pixel_formats,
+			obs_module_text("NDIPlugin.FilterProps.PixelFormat.Description"));
+
+		obs_property_t* divisor = obs_properties_add_int(props,
+			FLT_PROP_FRAME_DIVISOR,
+			obs_module_text("NDIPlugin.FilterProps.FrameDivisor"),
+			1, FLT_MAX_FRAME_DIVISOR, 1);
+		obs_property_set_long_description(divisor,
+			obs_module_text("NDIPlugin.FilterProps.FrameDivisor.Description"));
+
+		obs_property_t* scales = obs_properties_add_list(props,
+			FLT_PROP_OUTPUT_SCALE,
+			obs_module_text("NDIPlugin.FilterProps.OutputScale"),
+			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+		const int scale_percents[] = { 100, 75, 50, 33, 25 };
+		for (int percent : scale_percents) {
+			char label[8];
+			snprintf(label, sizeof(label), "%d%%", percent);
+			obs_property_list_add_int(scales, label, percent);
+		}
+	}
+
 	obs_properties_add_button(props, "ndi_apply",
 		obs_module_text("NDIPlugin.FilterProps.ApplySettings"), [](
 		obs_properties_t* pps,
@@ -114,113 +219,199 @@ void ndi_filter_getdefaults(obs_data_t* defaults)
 {
 	obs_data_set_default_string(defaults, FLT_PROP_NAME,
 		obs_module_text("NDIPlugin.FilterProps.NDIName.Default"));
+	obs_data_set_default_bool(defaults, FLT_PROP_ASYNC_SEND, true);
+	obs_data_set_default_int(defaults, FLT_PROP_READBACK_DEPTH, 1);
+	obs_data_set_default_int(defaults, FLT_PROP_PIXEL_FORMAT,
+		FLT_PIXEL_FORMAT_BGRA);
+	obs_data_set_default_int(defaults, FLT_PROP_FRAME_DIVISOR, 1);
+	obs_data_set_default_int(defaults, FLT_PROP_OUTPUT_SCALE, 100);
 }
 
-void ndi_filter_raw_video(void* data, video_data* frame)
+// Sends a read back frame, on a send worker. Frames are timestamped with
+// the time they were rendered at rather than the time they were read back.
+static void ndi_filter_send_video(void* data, const uint8_t* frame_data,
+	const struct readback_layout* layout, uint64_t timestamp)
 {
 	auto s = (struct ndi_filter*)data;
 
-	if (!frame || !frame->data[0])
-		return;
-
 	NDIlib_video_frame_v2_t video_frame = { 0 };
-	video_frame.xres = s->known_width;
-	video_frame.yres = s->known_height;
-	video_frame.FourCC = NDIlib_FourCC_type_BGRA;
+	video_frame.xres = layout->width;
+	video_frame.yres = layout->height;
+	video_frame.FourCC = (NDIlib_FourCC_type_e)layout->format;
 	video_frame.frame_rate_N = s->ovi.fps_num;
-	video_frame.frame_rate_D = s->ovi.fps_den;
+	video_frame.frame_rate_D = s->ovi.fps_den * layout->frame_divisor;
 	video_frame.picture_aspect_ratio = 0; // square pixels
 	video_frame.frame_format_type = NDIlib_frame_format_type_progressive;
-	video_frame.timecode = (frame->timestamp / 100);
-	video_frame.p_data = frame->data[0];
-	video_frame.line_stride_in_bytes = frame->linesize[0];
+	video_frame.timecode = (timestamp / 100);
+	video_frame.line_stride_in_bytes = layout->row_size;
+
+	struct ndi_sender_handle* handle = ndi_sender_acquire(&s->sender);
+	if (!handle)
+		return;
+
+	// The scheduler keeps the frame's buffer until the next send returns,
+	// which is as long as the SDK reads it in async mode
+	video_frame.p_data = (uint8_t*)frame_data;
+	if (handle->async_send) {
+		ndiLib->NDIlib_send_send_video_async_v2(handle->sender,
+			&video_frame);
+	} else {
+		ndiLib->NDIlib_send_send_video_v2(handle->sender, &video_frame);
+	}
+
+	ndi_sender_handle_release(handle);
+}
+
+// Falls back to BGRA for sizes the packing shader can't handle: UYVY
+// needs pixel pairs, and the UYVA alpha plane four-pixel groups and pairs
+// of rows
+static uint32_t ndi_filter_pixel_format(struct ndi_filter* s,
+	uint32_t requested, uint32_t width, uint32_t height)
+{
+	if (!s->convert_effect)
+		return FLT_PIXEL_FORMAT_BGRA;
+
+	switch (requested) {
+		case FLT_PIXEL_FORMAT_UYVY:
+			if ((width % 2) == 0)
+				return FLT_PIXEL_FORMAT_UYVY;
+			break;
+		case FLT_PIXEL_FORMAT_UYVA:
+			if ((width % 4) == 0 && (height % 2) == 0)
+				return FLT_PIXEL_FORMAT_UYVA;
+			break;
+	}
+	return FLT_PIXEL_FORMAT_BGRA;
+}
+
+// Renders texture packed as UYVY or UYVA into the conversion texrender,
+// with the colour matrix and range of OBS's video settings
+static gs_texture_t* ndi_filter_convert(struct ndi_filter* s,
+	gs_texture_t* texture, uint32_t pixel_format, uint32_t width,
+	uint32_t height, uint32_t rows)
+{
+	struct matrix4 color_matrix;
+	gpu_packing_color_matrix(s->ovi.colorspace, s->ovi.range,
+		&color_matrix);
 
-	pthread_mutex_lock(&s->ndi_sender_video_mutex);
-	ndiLib->NDIlib_send_send_video_v2(s->ndi_sender, &video_frame);
-	pthread_mutex_unlock(&s->ndi_sender_video_mutex);
+	return gpu_packing_render(s->convert_effect, s->convert_texrender,
+		texture, pixel_format == FLT_PIXEL_FORMAT_UYVA, width, height,
+		rows, &color_matrix);
 }
 
-void ndi_filter_offscreen_render(void* data, uint32_t cx, uint32_t cy)
+// Renders the parent source and stages it for the readback scheduler, on
+// the graphics thread
+static struct readback_ring* ndi_filter_stage_video(void* data,
+	struct readback_layout* layout)
 {
 	auto s = (struct ndi_filter*)data;
 
 	obs_source_t* target = obs_filter_get_parent(s->context);
 	if (!target) {
-		return;
+		return nullptr;
 	}
 
-	uint32_t width = obs_source_get_base_width(target);
-	uint32_t height = obs_source_get_base_height(target);
-
-	gs_texrender_reset(s->texrender);
-
-	if (gs_texrender_begin(s->texrender, width, height)) {
-		struct vec4 background;
-		vec4_zero(&background);
-
-		gs_clear(GS_CLEAR_COLOR, &background, 0.0f, 0);
-		gs_ortho(0.0f, (float)width, 0.0f, (float)height, -100.0f, 100.0f);
+	if (!ndi_connection_watch_has_receivers(s->connections)) {
+		// Nobody is watching: skip rendering and readback entirely, and
+		// don't send frames staged before going idle once resumed
+		readback_ring_discard(&s->readback);
+		return nullptr;
+	}
 
-		gs_blend_state_push();
-		gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+	// Skipped frames cost nothing: no render, no readback, no send
+	const struct ndi_filter_video_config config = ndi_filter_load_config(s);
+	const uint32_t frame_index = s->frame_count++;
+	if (config.frame_divisor > 1 &&
+		(frame_index % config.frame_divisor) != 0)
+	{
+		return nullptr;
+	}
 
-		obs_source_video_render(target);
+	uint32_t base_width = obs_source_get_base_width(target);
+	uint32_t base_height = obs_source_get_base_height(target);
 
-		gs_blend_state_pop();
-		gs_texrender_end(s->texrender);
+	// The parent is rendered straight into the smaller texture. Sizes
+	// stay even for the packed formats.
+	uint32_t width = base_width;
+	uint32_t height = base_height;
+	if (config.output_scale < 100) {
+		width = ((base_width * config.output_scale / 100) + 1) & ~1u;
+		height = ((base_height * config.output_scale / 100) + 1) & ~1u;
+	}
 
-		if (s->known_width != width || s->known_height != height) {
+	if (width == 0 || height == 0) {
+		return nullptr;
+	}
 
-			gs_stagesurface_destroy(s->stagesurface);
-			s->stagesurface =
-				gs_stagesurface_create(width, height, TEXFORMAT);
+	gs_texrender_reset(s->texrender);
 
-			video_output_info vi = {0};
-			vi.format = VIDEO_FORMAT_BGRA;
-			vi.width = width;
-			vi.height = height;
-			vi.fps_den = s->ovi.fps_den;
-			vi.fps_num = s->ovi.fps_num;
-			vi.cache_size = 16;
-			vi.colorspace = VIDEO_CS_DEFAULT;
-			vi.range = VIDEO_RANGE_DEFAULT;
-			vi.name = obs_source_get_name(s->context);
+	if (!gs_texrender_begin(s->texrender, width, height)) {
+		return nullptr;
+	}
 
-			video_output_close(s->video_output);
-			video_output_open(&s->video_output, &vi);
-			video_output_connect(s->video_output,
-				nullptr, ndi_filter_raw_video, s);
+	struct vec4 background;
+	vec4_zero(&background);
+
+	gs_clear(GS_CLEAR_COLOR, &background, 0.0f, 0);
+	gs_ortho(0.0f, (float)base_width, 0.0f, (float)base_height,
+		-100.0f, 100.0f);
+
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+
+	obs_source_video_render(target);
+
+	gs_blend_state_pop();
+	gs_texrender_end(s->texrender);
+
+	const uint32_t pixel_format = ndi_filter_pixel_format(s,
+		config.pixel_format, width, height);
+
+	// UYVA frames are followed by their alpha plane, packed two image
+	// rows per frame row
+	layout->width = width;
+	layout->height = height;
+	layout->rows = height;
+	layout->row_size = width * 4;
+	layout->frame_divisor = config.frame_divisor;
+	switch (pixel_format) {
+		case FLT_PIXEL_FORMAT_UYVY:
+			layout->format = NDIlib_FourCC_type_UYVY;
+			break;
+		case FLT_PIXEL_FORMAT_UYVA:
+			layout->format = NDIlib_FourCC_type_UYVA;
+			layout->rows = height + (height / 2);
+			break;
+		default:
+			layout->format = NDIlib_FourCC_type_BGRA;
+			break;
+	}
 
-			s->known_width = width;
-			s->known_height = height;
-		}
+	gs_texture_t* texture = gs_texrender_get_texture(s->texrender);
+	enum gs_color_format readback_format = TEXFORMAT;
+	if (pixel_format != FLT_PIXEL_FORMAT_BGRA) {
+		gs_texture_t* packed = ndi_filter_convert(s, texture,
+			pixel_format, width, height, layout->rows);
+		if (!packed)
+			return nullptr;
+
+		texture = packed;
+		layout->row_size = width * 2;
+		readback_format = GS_RGBA;
+	}
 
-		struct video_frame output_frame;
-		if (video_output_lock_frame(s->video_output,
-			&output_frame, 1, os_gettime_ns()))
-		{
-			if (s->video_data) {
-				gs_stagesurface_unmap(s->stagesurface);
-				s->video_data = nullptr;
-			}
-
-			gs_stage_texture(s->stagesurface,
-							 gs_texrender_get_texture(s->texrender));
-			gs_stagesurface_map(s->stagesurface,
-								&s->video_data, &s->video_linesize);
-
-			uint32_t linesize = output_frame.linesize[0];
-			for (uint32_t i = 0; i < s->known_height; ++i) {
-				uint32_t dst_offset = linesize * i;
-				uint32_t src_offset = s->video_linesize * i;
-				memcpy(output_frame.data[0] + dst_offset,
-					s->video_data + src_offset,
-					linesize);
-			}
-
-			video_output_unlock_frame(s->video_output);
-		}
+	if (readback_ring_update(&s->readback, layout->row_size / 4,
+		layout->rows, readback_format, config.readback_depth))
+	{
+		blog(LOG_INFO, "'%s': readback depth %u (+%.1f ms latency)",
+			obs_source_get_name(s->context), s->readback.depth,
+			readback_ring_latency_ns(&s->readback,
+				s->ovi.fps_num,
+				s->ovi.fps_den * config.frame_divisor) / 1000000.0);
 	}
+
+	readback_ring_stage(&s->readback, texture, os_gettime_ns());
+	return &s->readback;
 }
 
 void ndi_filter_update(void* data, obs_data_t* settings)
@@ -228,26 +419,59 @@ void ndi_filter_update(void* data, obs_data_t* settings)
 	UNUSED_PARAMETER(settings);
 	auto s = (struct ndi_filter*)data;
 
-	obs_remove_main_render_callback(ndi_filter_offscreen_render, s);
-
 	NDIlib_send_create_t send_desc;
 	send_desc.p_ndi_name = obs_data_get_string(settings, FLT_PROP_NAME);
 	send_desc.p_groups = nullptr;
 	send_desc.clock_video = false;
 	send_desc.clock_audio = false;
 
-	pthread_mutex_lock(&s->ndi_sender_video_mutex);
-	pthread_mutex_lock(&s->ndi_sender_audio_mutex);
-
-	ndiLib->NDIlib_send_destroy(s->ndi_sender);
-	s->ndi_sender = ndiLib->NDIlib_send_create(&send_desc);
-
-	pthread_mutex_unlock(&s->ndi_sender_audio_mutex);
-	pthread_mutex_unlock(&s->ndi_sender_video_mutex);
+	// Sends in flight finish on the previous sender, which is destroyed
+	// once they're done
+	NDIlib_send_instance_t sender = ndiLib->NDIlib_send_create(&send_desc);
+	ndi_connection_watch_set_sender(s->connections, nullptr);
+	ndi_sender_replace(&s->sender, sender,
+		obs_data_get_bool(settings, FLT_PROP_ASYNC_SEND));
+	ndi_connection_watch_set_sender(s->connections, sender);
+
+	// Applied by the render callback from the next frame on. Frames
+	// already read back are sent with the frame rate they were staged at.
+	struct ndi_filter_video_config config;
+	config.readback_depth =
+		(uint32_t)obs_data_get_int(settings, FLT_PROP_READBACK_DEPTH);
+	if (config.readback_depth > READBACK_RING_MAX_DEPTH)
+		config.readback_depth = READBACK_RING_MAX_DEPTH;
+	config.pixel_format =
+		(uint32_t)obs_data_get_int(settings, FLT_PROP_PIXEL_FORMAT);
+	config.output_scale =
+		(uint32_t)obs_data_get_int(settings, FLT_PROP_OUTPUT_SCALE);
+	if (config.output_scale == 0 || config.output_scale > 100)
+		config.output_scale = 100;
+	config.frame_divisor =
+		(uint32_t)obs_data_get_int(settings, FLT_PROP_FRAME_DIVISOR);
+	if (config.frame_divisor < 1)
+		config.frame_divisor = 1;
+	else if (config.frame_divisor > FLT_MAX_FRAME_DIVISOR)
+		config.frame_divisor = FLT_MAX_FRAME_DIVISOR;
+
+	os_atomic_set_long(&s->video_config, ndi_filter_pack_config(&config));
+}
 
-	if (!s->is_audioonly) {
-		obs_add_main_render_callback(ndi_filter_offscreen_render, s);
-	}
+static void ndi_filter_add_procs(struct ndi_filter* s)
+{
+	proc_handler_t* ph = obs_source_get_proc_handler(s->context);
+	proc_handler_add(ph, "void get_audio_send_stats(out int packets_sent, "
+		"out int overruns, out int underruns)",
+		[](void* data, calldata_t* cd) {
+			auto s = (struct ndi_filter*)data;
+			struct audio_send_queue_stats stats;
+			audio_send_queue_get_stats(s->audio_queue, &stats);
+
+			calldata_set_int(cd, "packets_sent",
+				(long long)stats.packets_sent);
+			calldata_set_int(cd, "overruns", (long long)stats.overruns);
+			calldata_set_int(cd, "underruns",
+				(long long)stats.underruns);
+		}, s);
 }
 
 void* ndi_filter_create(obs_data_t* settings, obs_source_t* source)
@@ -256,15 +480,33 @@ void* ndi_filter_create(obs_data_t* settings, obs_source_t* source)
 	s->is_audioonly = false;
 	s->context = source;
 	s->texrender = gs_texrender_create(TEXFORMAT, GS_ZS_NONE);
-	s->video_data = nullptr;
+	s->convert_texrender = gs_texrender_create(GS_RGBA, GS_ZS_NONE);
+
+	char* effect_path = obs_module_file("ndi-convert.effect");
+	obs_enter_graphics();
+	s->convert_effect = gs_effect_create_from_file(effect_path, nullptr);
+	obs_leave_graphics();
+	bfree(effect_path);
+	if (!s->convert_effect) {
+		blog(LOG_WARNING, "'%s': can't load the UYVY conversion effect, "
+			"sending BGRA", obs_source_get_name(source));
+	}
+
 	s->perf_token = os_request_high_performance("NDI Filter");
-	pthread_mutex_init(&s->ndi_sender_video_mutex, NULL);
-	pthread_mutex_init(&s->ndi_sender_audio_mutex, NULL);
+	s->connections = ndi_connection_watch_create(obs_source_get_name(source));
+	s->audio_queue = audio_send_queue_create(obs_source_get_name(source),
+		&s->sender, s->connections);
+	ndi_filter_add_procs(s);
 
 	obs_get_video_info(&s->ovi);
 	obs_get_audio_info(&s->oai);
 
 	ndi_filter_update(s, settings);
+
+	struct readback_client_callbacks callbacks = {};
+	callbacks.stage = ndi_filter_stage_video;
+	callbacks.send = ndi_filter_send_video;
+	s->readback_client = readback_client_create(source, &callbacks, s);
 	return s;
 }
 
@@ -274,8 +516,10 @@ void* ndi_filter_create_audioonly(obs_data_t* settings, obs_source_t* source)
 	s->is_audioonly = true;
 	s->context = source;
 	s->perf_token = os_request_high_performance("NDI Filter (Audio Only)");
-	pthread_mutex_init(&s->ndi_sender_audio_mutex, NULL);
-	pthread_mutex_init(&s->ndi_sender_video_mutex, NULL);
+	s->connections = ndi_connection_watch_create(obs_source_get_name(source));
+	s->audio_queue = audio_send_queue_create(obs_source_get_name(source),
+		&s->sender, s->connections);
+	ndi_filter_add_procs(s);
 
 	obs_get_audio_info(&s->oai);
 
@@ -287,20 +531,21 @@ void ndi_filter_destroy(void* data)
 {
 	auto s = (struct ndi_filter*)data;
 
-	obs_remove_main_render_callback(ndi_filter_offscreen_render, s);
-	video_output_close(s->video_output);
-
-	pthread_mutex_lock(&s->ndi_sender_video_mutex);
-	pthread_mutex_lock(&s->ndi_sender_audio_mutex);
+	// The sender is flushed before the scheduler releases the last frame
+	// sent, and the watch outlives the stage callback using it
+	ndi_connection_watch_set_sender(s->connections, nullptr);
+	audio_send_queue_destroy(s->audio_queue);
+	ndi_sender_slot_free(&s->sender);
 
-	ndiLib->NDIlib_send_destroy(s->ndi_sender);
+	readback_client_destroy(s->readback_client);
+	ndi_connection_watch_destroy(s->connections);
 
-	pthread_mutex_unlock(&s->ndi_sender_audio_mutex);
-	pthread_mutex_unlock(&s->ndi_sender_video_mutex);
-
-	gs_stagesurface_unmap(s->stagesurface);
-	gs_stagesurface_destroy(s->stagesurface);
+	obs_enter_graphics();
+	readback_ring_free(&s->readback);
 	gs_texrender_destroy(s->texrender);
+	gs_texrender_destroy(s->convert_texrender);
+	gs_effect_destroy(s->convert_effect);
+	obs_leave_graphics();
 
 	if (s->perf_token) {
 		os_end_high_performance(s->perf_token);
@@ -313,9 +558,9 @@ void ndi_filter_destroy_audioonly(void* data)
 {
 	auto s = (struct ndi_filter*)data;
 
-	pthread_mutex_lock(&s->ndi_sender_audio_mutex);
-	ndiLib->NDIlib_send_destroy(s->ndi_sender);
-	pthread_mutex_unlock(&s->ndi_sender_audio_mutex);
+	audio_send_queue_destroy(s->audio_queue);
+	ndi_connection_watch_destroy(s->connections);
+	ndi_sender_slot_free(&s->sender);
 
 	if (s->perf_token) {
 		os_end_high_performance(s->perf_token);
@@ -342,32 +587,14 @@ struct obs_audio_data* ndi_filter_asyncaudio(void *data,
 {
 	auto s = (struct ndi_filter*)data;
 
-	obs_get_audio_info(&s->oai);
+	if (!ndi_connection_watch_has_receivers(s->connections))
+		return audio_data;
 
-	NDIlib_audio_frame_v2_t audio_frame = { 0 };
-	audio_frame.sample_rate = s->oai.samples_per_sec;
-	audio_frame.no_channels = s->oai.speakers;
-	audio_frame.timecode = (int64_t)(audio_data->timestamp / 100);
-	audio_frame.no_samples = audio_data->frames;
-	audio_frame.channel_stride_in_bytes = audio_frame.no_samples * 4;
-
-	size_t data_size =
-		audio_frame.no_channels * audio_frame.channel_stride_in_bytes;
-	uint8_t* ndi_data = (uint8_t*)bmalloc(data_size);
-
-	for (int i = 0; i < audio_frame.no_channels; ++i) {
-		memcpy(&ndi_data[i * audio_frame.channel_stride_in_bytes],
-			audio_data->data[i],
-			audio_frame.channel_stride_in_bytes
-		);
-	}
-	audio_frame.p_data = (float*)ndi_data;
+	obs_get_audio_info(&s->oai);
 
-	pthread_mutex_lock(&s->ndi_sender_audio_mutex);
-	ndiLib->NDIlib_send_send_audio_v2(s->ndi_sender, &audio_frame);
-	pthread_mutex_unlock(&s->ndi_sender_audio_mutex);
+	audio_send_queue_push(s->audio_queue, audio_data,
+		(uint32_t)s->oai.speakers, s->oai.samples_per_sec);
 
-	bfree(ndi_data);
 	return audio_data;
 }
 
@@ -23,61 +23,36 @@ along with this program; If not, see <https://www.gnu.org/licenses/>
 #include <util/circlebuf.h>
 
 #include "obs-ndi.h"
-
-static FORCE_INLINE uint32_t min_uint32(uint32_t a, uint32_t b)
-{
-	return a < b ? a : b;
-}
-
-typedef void (*uyvy_conv_function)(uint8_t* input[], uint32_t in_linesize[],
-							  uint32_t start_y, uint32_t end_y,
-							  uint8_t* output, uint32_t out_linesize);
-
-static void convert_i444_to_uyvy(uint8_t* input[], uint32_t in_linesize[],
-						  uint32_t start_y, uint32_t end_y,
-						  uint8_t* output, uint32_t out_linesize)
-{
-	uint8_t* _Y;
-	uint8_t* _U;
-	uint8_t* _V;
-	uint8_t* _out;
-	uint32_t width = min_uint32(in_linesize[0], out_linesize);
-	for (uint32_t y = start_y; y < end_y; ++y) {
-		_Y = input[0] + (y * in_linesize[0]);
-		_U = input[1] + (y * in_linesize[1]);
-		_V = input[2] + (y * in_linesize[2]);
-
-		_out = output + (y * out_linesize);
-
-		for (uint32_t x = 0; x < width; x += 2) {
-			// Quality loss here. Some chroma samples are ignored.
-			*(_out++) = *(_U++); _U++;
-			*(_out++) = *(_Y++);
-			*(_out++) = *(_V++); _V++;
-			*(_out++) = *(_Y++);
-		}
-	}
-}
+#include "pixel-conversion.h"
+#include "conversion-pool.h"
+#include "send-buffers.h"
+#include "connection-monitor.h"
 
 struct ndi_output
 {
 	obs_output_t *output;
 	const char* ndi_name;
+	uint32_t conv_threads;
+	bool async_send;
 
 	bool started;
 	NDIlib_send_instance_t ndi_sender;
+	struct ndi_connection_watch* connections;
 
 	uint32_t frame_width;
 	uint32_t frame_height;
 	NDIlib_FourCC_type_e frame_fourcc;
 	double video_framerate;
+	uint32_t plane_heights[MAX_AV_PLANES];
+	int plane_count;
 
 	size_t audio_channels;
 	uint32_t audio_samplerate;
 
-	uint8_t* conv_buffer;
+	struct ndi_send_buffers send_buffers;
 	uint32_t conv_linesize;
 	uyvy_conv_function conv_function;
+	struct conversion_pool* conv_pool;
 
 	uint8_t* audio_conv_buffer;
 	size_t audio_conv_buffer_size;
@@ -101,6 +76,16 @@ obs_properties_t* ndi_output_getproperties(void* data)
 	obs_properties_add_text(props, "ndi_name",
 		obs_module_text("NDIPlugin.OutputProps.NDIName"), OBS_TEXT_DEFAULT);
 
+	obs_property_t* conv_threads = obs_properties_add_int(props,
+		"conv_threads",
+		obs_module_text("NDIPlugin.OutputProps.ConversionThreads"),
+		0, 16, 1);
+	obs_property_set_long_description(conv_threads,
+		obs_module_text("NDIPlugin.OutputProps.ConversionThreads.Auto"));
+
+	obs_properties_add_bool(props, "async_send",
+		obs_module_text("NDIPlugin.OutputProps.AsyncSend"));
+
 	return props;
 }
 
@@ -108,6 +93,8 @@ void ndi_output_getdefaults(obs_data_t* settings)
 {
 	obs_data_set_default_string(settings,
 								"ndi_name", "obs-ndi output (changeme)");
+	obs_data_set_default_int(settings, "conv_threads", 0);
+	obs_data_set_default_bool(settings, "async_send", true);
 }
 
 bool ndi_output_start(void* data)
@@ -129,34 +116,54 @@ bool ndi_output_start(void* data)
 		uint32_t height = video_output_get_height(video);
 
 		switch (format) {
-			case VIDEO_FORMAT_I444:
-				o->conv_function = convert_i444_to_uyvy;
+			case VIDEO_FORMAT_I444: {
+				const char* conv_name = nullptr;
+				o->conv_function = get_i444_to_uyvy_function(&conv_name);
 				if (!o->conv_function) {
 					return false;
 				}
+				blog(LOG_INFO, "'%s': using %s I444 to UYVY conversion",
+					o->ndi_name, conv_name);
 				o->frame_fourcc = NDIlib_FourCC_type_UYVY;
 				o->conv_linesize = width * 2;
-				o->conv_buffer = new uint8_t[height * o->conv_linesize * 2]();
+
+				o->conv_pool = conversion_pool_create(o->conv_threads);
+				blog(LOG_INFO, "'%s': converting frames in %u row bands",
+					o->ndi_name, conversion_pool_get_size(o->conv_pool));
 				break;
+			}
 
 			case VIDEO_FORMAT_NV12:
 				o->frame_fourcc = NDIlib_FourCC_type_NV12;
+				o->plane_count = 2;
+				o->plane_heights[0] = height;
+				o->plane_heights[1] = height / 2;
 				break;
 
 			case VIDEO_FORMAT_I420:
 				o->frame_fourcc = NDIlib_FourCC_type_I420;
+				o->plane_count = 3;
+				o->plane_heights[0] = height;
+				o->plane_heights[1] = height / 2;
+				o->plane_heights[2] = height / 2;
 				break;
 
 			case VIDEO_FORMAT_RGBA:
 				o->frame_fourcc = NDIlib_FourCC_type_RGBA;
+				o->plane_count = 1;
+				o->plane_heights[0] = height;
 				break;
 
 			case VIDEO_FORMAT_BGRA:
 				o->frame_fourcc = NDIlib_FourCC_type_BGRA;
+				o->plane_count = 1;
+				o->plane_heights[0] = height;
 				break;
 
 			case VIDEO_FORMAT_BGRX:
 				o->frame_fourcc = NDIlib_FourCC_type_BGRX;
+				o->plane_count = 1;
+				o->plane_heights[0] = height;
 				break;
 
 			default:
@@ -184,6 +191,8 @@ bool ndi_output_start(void* data)
 
 	o->ndi_sender = ndiLib->NDIlib_send_create(&send_desc);
 	if (o->ndi_sender) {
+		ndi_connection_watch_set_sender(o->connections, o->ndi_sender);
+
 		if (o->perf_token) {
 			os_end_high_performance(o->perf_token);
 		}
@@ -212,8 +221,12 @@ void ndi_output_stop(void* data, uint64_t ts)
 	os_end_high_performance(o->perf_token);
 	o->perf_token = NULL;
 
+	ndi_connection_watch_set_sender(o->connections, nullptr);
+	ndi_send_buffers_flush(o->ndi_sender);
 	ndiLib->NDIlib_send_destroy(o->ndi_sender);
-	delete o->conv_buffer;
+	ndi_send_buffers_free(&o->send_buffers);
+	conversion_pool_destroy(o->conv_pool);
+	o->conv_pool = nullptr;
 	o->conv_function = nullptr;
 
 	o->frame_width = 0;
@@ -228,6 +241,8 @@ void ndi_output_update(void* data, obs_data_t* settings)
 {
 	auto o = (struct ndi_output*)data;
 	o->ndi_name = obs_data_get_string(settings, "ndi_name");
+	o->conv_threads = (uint32_t)obs_data_get_int(settings, "conv_threads");
+	o->async_send = obs_data_get_bool(settings, "async_send");
 }
 
 void* ndi_output_create(obs_data_t* settings, obs_output_t* output)
@@ -238,6 +253,16 @@ void* ndi_output_create(obs_data_t* settings, obs_output_t* output)
 	o->audio_conv_buffer = nullptr;
 	o->audio_conv_buffer_size = 0;
 	o->perf_token = NULL;
+	o->connections = ndi_connection_watch_create(obs_output_get_name(output));
+
+	// Lets the preview output skip rendering when nobody is watching
+	proc_handler_t* ph = obs_output_get_proc_handler(output);
+	proc_handler_add(ph, "void get_connection_watch(out ptr watch)",
+		[](void* data, calldata_t* cd) {
+			auto o = (struct ndi_output*)data;
+			calldata_set_ptr(cd, "watch", o->connections);
+		}, o);
+
 	ndi_output_update(o, settings);
 	return o;
 }
@@ -245,6 +270,7 @@ void* ndi_output_create(obs_data_t* settings, obs_output_t* output)
 void ndi_output_destroy(void* data)
 {
 	auto o = (struct ndi_output*)data;
+	ndi_connection_watch_destroy(o->connections);
 	if (o->audio_conv_buffer) {
 		bfree(o->audio_conv_buffer);
 	}
@@ -258,6 +284,9 @@ void ndi_output_rawvideo(void* data, struct video_data* frame)
 	if (!o->started || !o->frame_width || !o->frame_height)
 		return;
 
+	if (!ndi_connection_watch_has_receivers(o->connections))
+		return;
+
 	uint32_t width = o->frame_width;
 	uint32_t height = o->frame_height;
 
@@ -272,18 +301,47 @@ void ndi_output_rawvideo(void* data, struct video_data* frame)
 
 	video_frame.FourCC = o->frame_fourcc;
 	if (video_frame.FourCC == NDIlib_FourCC_type_UYVY) {
-		o->conv_function(frame->data, frame->linesize,
-							 0, height,
-							 o->conv_buffer, o->conv_linesize);
-		video_frame.p_data = o->conv_buffer;
+		uint8_t* conv_buffer = ndi_send_buffers_acquire(&o->send_buffers,
+			o->ndi_sender, height * o->conv_linesize);
+
+		conversion_pool_run(o->conv_pool, o->conv_function,
+							frame->data, frame->linesize, height,
+							conv_buffer, o->conv_linesize);
+		video_frame.p_data = conv_buffer;
 		video_frame.line_stride_in_bytes = o->conv_linesize;
 	}
+	else if (o->async_send) {
+		// OBS reuses the frame as soon as we return, but the SDK reads
+		// it until the next send: keep a copy, with planes laid out
+		// contiguously as NDI expects them.
+		size_t frame_size = 0;
+		for (int i = 0; i < o->plane_count; ++i) {
+			frame_size += frame->linesize[i] * o->plane_heights[i];
+		}
+
+		uint8_t* buffer = ndi_send_buffers_acquire(&o->send_buffers,
+			o->ndi_sender, frame_size);
+
+		uint8_t* plane = buffer;
+		for (int i = 0; i < o->plane_count; ++i) {
+			size_t plane_size = frame->linesize[i] * o->plane_heights[i];
+			memcpy(plane, frame->data[i], plane_size);
+			plane += plane_size;
+		}
+
+		video_frame.p_data = buffer;
+		video_frame.line_stride_in_bytes = frame->linesize[0];
+	}
 	else {
 		video_frame.p_data = frame->data[0];
 		video_frame.line_stride_in_bytes = frame->linesize[0];
 	}
 
-	ndiLib->NDIlib_send_send_video_v2(o->ndi_sender, &video_frame);
+	if (o->async_send) {
+		ndiLib->NDIlib_send_send_video_async_v2(o->ndi_sender, &video_frame);
+	} else {
+		ndiLib->NDIlib_send_send_video_v2(o->ndi_sender, &video_frame);
+	}
 }
 
 void ndi_output_rawaudio(void* data, struct audio_data* frame)
@@ -293,6 +351,9 @@ void ndi_output_rawaudio(void* data, struct audio_data* frame)
 	if (!o->started || !o->audio_samplerate || !o->audio_channels)
 		return;
 
+	if (!ndi_connection_watch_has_receivers(o->connections))
+		return;
+
 	NDIlib_audio_frame_v2_t audio_frame = {0};
 	audio_frame.sample_rate = o->audio_samplerate;
 	audio_frame.no_channels = (int)o->audio_channels;
@@ -23,10 +23,20 @@ along with this program; If not, see <https://www.gnu.org/licenses/>
 #include <obs-module.h>
 #include <util/platform.h>
 #include <util/threading.h>
+#include <callback/proc.h>
 #include <chrono>
-#include <thread>
+#include <cmath>
+#include <cstdio>
 
 #include "obs-ndi.h"
+#include "ndi-receiver.h"
+#include "ndi-discovery.h"
+#include "clock-mapper.h"
+#include "frame-pool.h"
+#include "jitter-buffer.h"
+#include "audio-conversion.h"
+#include "pixel-conversion.h"
+#include "deinterlace.h"
 
 #define PROP_SOURCE "ndi_source_name"
 #define PROP_BANDWIDTH "ndi_bw_mode"
@@ -36,10 +46,17 @@ along with this program; If not, see <https://www.gnu.org/licenses/>
 #define PROP_YUV_RANGE "yuv_range"
 #define PROP_YUV_COLORSPACE "yuv_colorspace"
 #define PROP_LATENCY "latency"
+#define PROP_FRAMESYNC "ndi_framesync"
+#define PROP_JITTER_BUFFER_MAX "ndi_jitter_buffer_max"
+#define PROP_AUDIO_MAPPING "ndi_audio_mapping"
+#define PROP_DEINTERLACE "ndi_deinterlace"
+#define PROP_STATS "ndi_stats"
+#define PROP_STATS_REFRESH "ndi_stats_refresh"
 
 #define PROP_BW_HIGHEST 0
 #define PROP_BW_LOWEST 1
 #define PROP_BW_AUDIO_ONLY 2
+#define PROP_BW_AUTO 3
 
 #define PROP_SYNC_INTERNAL 0
 #define PROP_SYNC_NDI_TIMESTAMP 1
@@ -54,22 +71,125 @@ along with this program; If not, see <https://www.gnu.org/licenses/>
 #define PROP_LATENCY_NORMAL 0
 #define PROP_LATENCY_LOW 1
 
-extern NDIlib_find_instance_t ndi_finder;
+// Seconds between two samples of the receiver counters, and between two
+// statistics log lines
+#define STATS_SAMPLE_INTERVAL 1.0f
+#define STATS_LOG_INTERVAL 60.0f
 
-struct ndi_source
+// Seconds a source in automatic bandwidth mode keeps the highest bandwidth
+// after leaving preview and program, so that quick cuts back to it don't
+// switch again
+#define AUTO_BANDWIDTH_HOLD_TIME 5.0f
+
+// Settings used while receiving frames, which can change without
+// reconnecting the receiver
+struct ndi_source_render_config
 {
-	obs_source_t* source;
-	NDIlib_recv_instance_t ndi_receiver;
 	int sync_mode;
 	video_range_type yuv_range;
 	video_colorspace yuv_colorspace;
-	pthread_t av_thread;
-	bool running;
+	bool framesync_enabled;
+	bool audio_only;
+	bool jitter_buffer_enabled;
+	bool audio_downmix;
+	enum deinterlace_mode deinterlace;
+};
+
+struct ndi_source_stats
+{
+	bool connected;
+	struct ndi_receiver_stats receiver;
+
+	// Sender timestamp to output to OBS, and deviation of the interval
+	// between two frames from the frame duration. Both smoothed.
+	double latency_ms;
+	double jitter_ms;
+	bool latency_measured;
+	uint64_t last_video_ts;
+
+	// Frames actually passed to obs_source_output_video
+	int64_t frames_output;
+
+	struct jitter_buffer_stats jitter_buffer;
+	struct frame_pool_stats frame_pool;
+};
+
+struct ndi_source
+{
+	obs_source_t* source;
+	struct ndi_receiver_subscriber* subscriber;
+
+	// Packed ndi_source_render_config, swapped in one atomic store by
+	// ndi_source_update and loaded once per frame by the callbacks
+	volatile long render_config;
+
 	NDIlib_tally_t tally;
 	bool alpha_filter_enabled;
-	os_performance_token_t* perf_token;
+
+	// Maps NDI timestamps or timecodes, depending on the sync mode
+	struct clock_mapper clock;
+
+	// Frames the plugin fills itself: conversion output, and frames
+	// queued in the jitter buffer
+	struct frame_pool frame_pool;
+
+	// Low latency mode: frames are output from the tick, on the sender's
+	// cadence, rather than as soon as they are received
+	struct jitter_buffer jitter_buffer;
+
+	// Only used by the receiver's audio thread
+	struct audio_remap audio_remap;
+
+	// Only used by the receiver's video thread
+	struct deinterlacer deinterlacer;
+
+#if LIBOBS_API_VER >= MAKE_SEMANTIC_VERSION(26, 1, 0)
+	// UYVA frames are output as I42A, which older versions don't have:
+	// there, receivers request UYVY_BGRA and never get any
+	uyvy_split_function split_function;
+#endif
+
+	// Guards the connection settings below
+	pthread_mutex_t connect_mutex;
+	struct ndi_receiver_config connect_config;
+	bool bandwidth_auto;
+	float off_air_time;
+
+	pthread_mutex_t stats_mutex;
+	struct ndi_source_stats stats;
+	float stats_sample_elapsed;
+	float stats_log_elapsed;
 };
 
+static long pack_render_config(const struct ndi_source_render_config* config)
+{
+	return (long)(config->sync_mode & 0xff) |
+		((long)(config->yuv_range & 0xff) << 8) |
+		((long)(config->yuv_colorspace & 0xff) << 16) |
+		((long)config->framesync_enabled << 24) |
+		((long)config->audio_only << 25) |
+		((long)config->jitter_buffer_enabled << 26) |
+		((long)config->audio_downmix << 27) |
+		((long)(config->deinterlace & 0x3) << 28);
+}
+
+static struct ndi_source_render_config load_render_config(
+	struct ndi_source* s)
+{
+	long packed = os_atomic_load_long(&s->render_config);
+
+	struct ndi_source_render_config config;
+	config.sync_mode = (int)(packed & 0xff);
+	config.yuv_range = (video_range_type)((packed >> 8) & 0xff);
+	config.yuv_colorspace = (video_colorspace)((packed >> 16) & 0xff);
+	config.framesync_enabled = ((packed >> 24) & 1) != 0;
+	config.audio_only = ((packed >> 25) & 1) != 0;
+	config.jitter_buffer_enabled = ((packed >> 26) & 1) != 0;
+	config.audio_downmix = ((packed >> 27) & 1) != 0;
+	config.deinterlace = (enum deinterlace_mode)((packed >> 28) & 0x3);
+	return config;
+}
+
 static obs_source_t* find_filter_by_id(obs_source_t* context, const char* id)
 {
 	if (!context)
@@ -100,32 +220,6 @@ static obs_source_t* find_filter_by_id(obs_source_t* context, const char* id)
 	return filter_search.result;
 }
 
-static speaker_layout channel_count_to_layout(int channels)
-{
-	switch (channels) {
-	case 1:
-		return SPEAKERS_MONO;
-	case 2:
-		return SPEAKERS_STEREO;
-	case 3:
-		return SPEAKERS_2POINT1;
-	case 4:
-#if LIBOBS_API_VER >= MAKE_SEMANTIC_VERSION(21, 0, 0)
-		return SPEAKERS_4POINT0;
-#else
-		return SPEAKERS_QUAD;
-#endif
-	case 5:
-		return SPEAKERS_4POINT1;
-	case 6:
-		return SPEAKERS_5POINT1;
-	case 8:
-		return SPEAKERS_7POINT1;
-	default:
-		return SPEAKERS_UNKNOWN;
-	}
-}
-
 static video_colorspace prop_to_colorspace(int index)
 {
 	switch (index) {
@@ -147,6 +241,192 @@ static video_range_type prop_to_range_type(int index) {
 	}
 }
 
+static int64_t utc_now_100ns()
+{
+	using namespace std::chrono;
+	return duration_cast<nanoseconds>(
+		system_clock::now().time_since_epoch()).count() / 100;
+}
+
+static void ndi_source_measure_video(struct ndi_source* s,
+	const NDIlib_video_frame_v2_t* frame, uint64_t local_ts)
+{
+	pthread_mutex_lock(&s->stats_mutex);
+	struct ndi_source_stats* stats = &s->stats;
+
+	// Interarrival jitter, smoothed as in RFC 3550
+	if (stats->last_video_ts && frame->frame_rate_N > 0) {
+		double interval_ms =
+			(double)(local_ts - stats->last_video_ts) / 1000000.0;
+		double expected_ms =
+			1000.0 * frame->frame_rate_D / frame->frame_rate_N;
+		double deviation = std::fabs(interval_ms - expected_ms);
+		stats->jitter_ms += (deviation - stats->jitter_ms) / 16.0;
+	}
+	stats->last_video_ts = local_ts;
+
+	// NDI timestamps are the sender's UTC time, in 100 ns units: this
+	// only makes sense with clocks synchronized across machines
+	if (frame->timestamp != NDIlib_recv_timestamp_undefined) {
+		double latency_ms =
+			(double)(utc_now_100ns() - frame->timestamp) / 10000.0;
+		if (!stats->latency_measured) {
+			stats->latency_ms = latency_ms;
+			stats->latency_measured = true;
+		} else {
+			stats->latency_ms += (latency_ms - stats->latency_ms) / 16.0;
+		}
+	}
+
+	pthread_mutex_unlock(&s->stats_mutex);
+}
+
+// Outputs a received frame. Frames the jitter buffer drops never get here.
+static void ndi_source_output_frame(struct ndi_source* s,
+	const struct obs_source_frame* frame)
+{
+	obs_source_output_video(s->source, frame);
+
+	pthread_mutex_lock(&s->stats_mutex);
+	s->stats.frames_output++;
+	pthread_mutex_unlock(&s->stats_mutex);
+}
+
+static struct ndi_source_stats ndi_source_get_stats(struct ndi_source* s)
+{
+	pthread_mutex_lock(&s->stats_mutex);
+	struct ndi_source_stats stats = s->stats;
+	pthread_mutex_unlock(&s->stats_mutex);
+
+	jitter_buffer_get_stats(&s->jitter_buffer, &stats.jitter_buffer);
+	frame_pool_get_stats(&s->frame_pool, &stats.frame_pool);
+	return stats;
+}
+
+static void ndi_source_sample_stats(struct ndi_source* s)
+{
+	struct ndi_receiver_stats receiver_stats = {};
+	bool connected = ndi_receiver_get_stats(s->subscriber, &receiver_stats);
+
+	pthread_mutex_lock(&s->stats_mutex);
+	s->stats.connected = connected;
+	s->stats.receiver = receiver_stats;
+	pthread_mutex_unlock(&s->stats_mutex);
+}
+
+static long long ndi_source_bytes_copied_per_frame(
+	const struct ndi_source_stats* stats)
+{
+	if (stats->frames_output == 0)
+		return 0;
+	return (long long)(stats->frame_pool.bytes_copied /
+		(uint64_t)stats->frames_output);
+}
+
+static void ndi_source_format_stats(struct ndi_source* s,
+	char* text, size_t size)
+{
+	const struct ndi_source_stats stats = ndi_source_get_stats(s);
+
+	if (!stats.connected) {
+		snprintf(text, size, "%s",
+			obs_module_text("NDIPlugin.SourceProps.Stats.NotConnected"));
+		return;
+	}
+
+	// Only the labels are translated: the format string stays in code
+	const char* frames = obs_module_text("NDIPlugin.SourceProps.Stats.Frames");
+	const char* dropped =
+		obs_module_text("NDIPlugin.SourceProps.Stats.Dropped");
+	const char* queued = obs_module_text("NDIPlugin.SourceProps.Stats.Queued");
+
+	snprintf(text, size,
+		"%s: %lld %s, %lld %s, %d %s\n"
+		"%s: %lld %s, %lld %s, %d %s\n"
+		"%s: %.1f ms\n"
+		"%s: %.2f ms\n"
+		"%s: %u ms, %u %s, %lld %s, %lld %s\n"
+		"%s: %lld %s, %lld %s",
+		obs_module_text("NDIPlugin.SourceProps.Stats.Video"),
+		(long long)stats.receiver.video_frames, frames,
+		(long long)stats.receiver.dropped_video_frames, dropped,
+		stats.receiver.video_queue, queued,
+		obs_module_text("NDIPlugin.SourceProps.Stats.Audio"),
+		(long long)stats.receiver.audio_frames, frames,
+		(long long)stats.receiver.dropped_audio_frames, dropped,
+		stats.receiver.audio_queue, queued,
+		obs_module_text("NDIPlugin.SourceProps.Stats.Latency"),
+		stats.latency_ms,
+		obs_module_text("NDIPlugin.SourceProps.Stats.Jitter"),
+		stats.jitter_ms,
+		obs_module_text("NDIPlugin.SourceProps.Stats.JitterBuffer"),
+		stats.jitter_buffer.depth_ms,
+		stats.jitter_buffer.queued, queued,
+		(long long)stats.jitter_buffer.late,
+		obs_module_text("NDIPlugin.SourceProps.Stats.Late"),
+		(long long)stats.jitter_buffer.dropped, dropped,
+		obs_module_text("NDIPlugin.SourceProps.Stats.FrameBuffers"),
+		(long long)stats.frame_pool.allocations,
+		obs_module_text("NDIPlugin.SourceProps.Stats.Allocated"),
+		ndi_source_bytes_copied_per_frame(&stats),
+		obs_module_text("NDIPlugin.SourceProps.Stats.BytesCopied"));
+}
+
+static void ndi_source_log_stats(struct ndi_source* s)
+{
+	const struct ndi_source_stats stats = ndi_source_get_stats(s);
+	if (!stats.connected)
+		return;
+
+	blog(LOG_INFO, "[NDI Source '%s'] video: %lld frames, %lld dropped, "
+		"%d queued | audio: %lld frames, %lld dropped, %d queued | "
+		"latency: %.1f ms, jitter: %.2f ms | jitter buffer: %u ms, "
+		"%u queued, %lld late, %lld dropped | frame buffers: "
+		"%lld allocated, %lld bytes copied per frame",
+		obs_source_get_name(s->source),
+		(long long)stats.receiver.video_frames,
+		(long long)stats.receiver.dropped_video_frames,
+		stats.receiver.video_queue,
+		(long long)stats.receiver.audio_frames,
+		(long long)stats.receiver.dropped_audio_frames,
+		stats.receiver.audio_queue,
+		stats.latency_ms, stats.jitter_ms,
+		stats.jitter_buffer.depth_ms, stats.jitter_buffer.queued,
+		(long long)stats.jitter_buffer.late,
+		(long long)stats.jitter_buffer.dropped,
+		(long long)stats.frame_pool.allocations,
+		ndi_source_bytes_copied_per_frame(&stats));
+}
+
+// Statistics are shown as the description of an info property: they're
+// runtime data, and never go through the source's settings
+static void ndi_source_show_stats(struct ndi_source* s, obs_property_t* prop)
+{
+	char text[512];
+	ndi_source_format_stats(s, text, sizeof(text));
+	obs_property_set_description(prop, text);
+}
+
+// Takes NDI timestamps and timecodes (100 ns units) to the OBS clock
+static uint64_t ndi_source_map_time(struct ndi_source* s,
+	enum clock_mapper_stream stream, int64_t ndi_time, uint64_t local_ts)
+{
+	if (ndi_time == NDIlib_recv_timestamp_undefined)
+		return local_ts;
+
+	return clock_mapper_map(&s->clock, stream, ndi_time * 100, local_ts);
+}
+
+// Sender time the jitter buffer maps, on the same base as the sync mode's
+// so that the clock mapper sees a single clock
+static int64_t ndi_source_jitter_time(
+	const struct ndi_source_render_config& config, int64_t timestamp,
+	int64_t timecode)
+{
+	return (config.sync_mode == PROP_SYNC_NDI_SOURCE_TIMECODE) ?
+		timecode : timestamp;
+}
+
 static obs_source_frame* blank_video_frame()
 {
 	obs_source_frame* frame = obs_source_frame_create(VIDEO_FORMAT_NONE, 0, 0);
@@ -172,13 +452,14 @@ obs_properties_t* ndi_source_getproperties(void* data)
 		OBS_COMBO_TYPE_EDITABLE,
 		OBS_COMBO_FORMAT_STRING);
 
-	uint32_t nbSources = 0;
-	const NDIlib_source_t* sources = ndiLib->NDIlib_find_get_current_sources(ndi_finder,
-		&nbSources);
-
-	for (uint32_t i = 0; i < nbSources; ++i) {
-		obs_property_list_add_string(source_list,
-			sources[i].p_ndi_name, sources[i].p_ndi_name);
+	// Read from the discovery thread's latest snapshot: never blocks
+	struct ndi_discovery_snapshot* discovered = ndi_discovery_get_snapshot();
+	if (discovered) {
+		for (size_t i = 0; i < discovered->count; ++i) {
+			obs_property_list_add_string(source_list,
+				discovered->names[i], discovered->names[i]);
+		}
+		ndi_discovery_snapshot_release(discovered);
 	}
 
 	obs_property_t* bw_modes = obs_properties_add_list(props, PROP_BANDWIDTH,
@@ -192,6 +473,8 @@ obs_properties_t* ndi_source_getproperties(void* data)
 		obs_module_text("NDIPlugin.BWMode.Lowest"), PROP_BW_LOWEST);
 	obs_property_list_add_int(bw_modes,
 		obs_module_text("NDIPlugin.BWMode.AudioOnly"), PROP_BW_AUDIO_ONLY);
+	obs_property_list_add_int(bw_modes,
+		obs_module_text("NDIPlugin.BWMode.Auto"), PROP_BW_AUTO);
 
 	obs_property_set_modified_callback(bw_modes, [](
 		obs_properties_t *props,
@@ -250,6 +533,28 @@ obs_properties_t* ndi_source_getproperties(void* data)
 	obs_property_list_add_int(yuv_spaces, "BT.709", PROP_YUV_SPACE_BT709);
 	obs_property_list_add_int(yuv_spaces, "BT.601", PROP_YUV_SPACE_BT601);
 
+	obs_property_t* framesync = obs_properties_add_bool(props, PROP_FRAMESYNC,
+		obs_module_text("NDIPlugin.SourceProps.FrameSync"));
+
+	obs_property_set_modified_callback(framesync, [](
+		obs_properties_t *props,
+		obs_property_t *property,
+		obs_data_t *settings)
+	{
+		bool framesync_enabled = obs_data_get_bool(settings, PROP_FRAMESYNC);
+
+		obs_property_set_visible(obs_properties_get(props, PROP_SYNC),
+			!framesync_enabled);
+		obs_property_set_visible(obs_properties_get(props, PROP_LATENCY),
+			!framesync_enabled);
+		obs_property_set_visible(
+			obs_properties_get(props, PROP_JITTER_BUFFER_MAX),
+			!framesync_enabled && obs_data_get_int(settings,
+				PROP_LATENCY) == PROP_LATENCY_LOW);
+
+		return true;
+	});
+
 	obs_property_t* latency_modes = obs_properties_add_list(props, PROP_LATENCY,
 		obs_module_text("NDIPlugin.SourceProps.Latency"),
 		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
@@ -261,6 +566,80 @@ obs_properties_t* ndi_source_getproperties(void* data)
 		obs_module_text("NDIPlugin.SourceProps.Latency.Low"),
 		PROP_LATENCY_LOW);
 
+	obs_property_set_modified_callback(latency_modes, [](
+		obs_properties_t *props,
+		obs_property_t *property,
+		obs_data_t *settings)
+	{
+		obs_property_set_visible(
+			obs_properties_get(props, PROP_JITTER_BUFFER_MAX),
+			!obs_data_get_bool(settings, PROP_FRAMESYNC) &&
+			obs_data_get_int(settings, PROP_LATENCY) == PROP_LATENCY_LOW);
+
+		return true;
+	});
+
+	obs_property_t* jitter_buffer_max = obs_properties_add_int_slider(props,
+		PROP_JITTER_BUFFER_MAX,
+		obs_module_text("NDIPlugin.SourceProps.JitterBufferMax"), 0, 500, 10);
+	obs_property_set_long_description(jitter_buffer_max,
+		obs_module_text("NDIPlugin.SourceProps.JitterBufferMax.Description"));
+
+	obs_property_t* audio_mappings = obs_properties_add_list(props,
+		PROP_AUDIO_MAPPING,
+		obs_module_text("NDIPlugin.SourceProps.AudioMapping"),
+		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+
+	obs_property_list_add_int(audio_mappings,
+		obs_module_text("NDIPlugin.SourceProps.AudioMapping.Route"),
+		AUDIO_MAPPING_ROUTE);
+	obs_property_list_add_int(audio_mappings,
+		obs_module_text("NDIPlugin.SourceProps.AudioMapping.DownmixStereo"),
+		AUDIO_MAPPING_DOWNMIX_STEREO);
+
+	obs_property_t* deinterlace_modes = obs_properties_add_list(props,
+		PROP_DEINTERLACE,
+		obs_module_text("NDIPlugin.SourceProps.Deinterlace"),
+		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+
+	obs_property_list_add_int(deinterlace_modes,
+		obs_module_text("NDIPlugin.SourceProps.Deinterlace.Weave"),
+		DEINTERLACE_WEAVE);
+	obs_property_list_add_int(deinterlace_modes,
+		obs_module_text("NDIPlugin.SourceProps.Deinterlace.Bob"),
+		DEINTERLACE_BOB);
+	obs_property_list_add_int(deinterlace_modes,
+		obs_module_text("NDIPlugin.SourceProps.Deinterlace.Adaptive"),
+		DEINTERLACE_ADAPTIVE);
+
+#if LIBOBS_API_VER >= MAKE_SEMANTIC_VERSION(27, 0, 0)
+	obs_property_t* stats = obs_properties_add_text(props, PROP_STATS,
+		obs_module_text("NDIPlugin.SourceProps.Stats"), OBS_TEXT_INFO);
+#else
+	// Shown as the label of an empty, disabled field
+	obs_property_t* stats = obs_properties_add_text(props, PROP_STATS,
+		obs_module_text("NDIPlugin.SourceProps.Stats"), OBS_TEXT_DEFAULT);
+	obs_property_set_enabled(stats, false);
+#endif
+
+	obs_properties_add_button(props, PROP_STATS_REFRESH,
+		obs_module_text("NDIPlugin.SourceProps.Stats.Refresh"), [](
+		obs_properties_t *pps,
+		obs_property_t *prop,
+		void* private_data)
+	{
+		auto s = (struct ndi_source*)private_data;
+		obs_property_t* stats = obs_properties_get(pps, PROP_STATS);
+		if (s && stats) {
+			ndi_source_show_stats(s, stats);
+		}
+		return true;
+	});
+
+	if (s) {
+		ndi_source_show_stats(s, stats);
+	}
+
 	obs_properties_add_button(props, "ndi_website", "NDI.NewTek.com", [](
 		obs_properties_t *pps,
 		obs_property_t *prop,
@@ -285,154 +664,235 @@ void ndi_source_getdefaults(obs_data_t* settings)
 	obs_data_set_default_int(settings, PROP_YUV_RANGE, PROP_YUV_RANGE_PARTIAL);
 	obs_data_set_default_int(settings, PROP_YUV_COLORSPACE, PROP_YUV_SPACE_BT709);
 	obs_data_set_default_int(settings, PROP_LATENCY, PROP_LATENCY_NORMAL);
+	obs_data_set_default_int(settings, PROP_JITTER_BUFFER_MAX, 100);
+	obs_data_set_default_int(settings, PROP_AUDIO_MAPPING, AUDIO_MAPPING_ROUTE);
+	obs_data_set_default_int(settings, PROP_DEINTERLACE, DEINTERLACE_WEAVE);
+	obs_data_set_default_bool(settings, PROP_FRAMESYNC, false);
 }
 
-void* ndi_source_poll_audio_video(void* data)
+#if LIBOBS_API_VER >= MAKE_SEMANTIC_VERSION(26, 1, 0)
+// Splits the UYVY part of a UYVA frame into planes. The alpha plane that
+// follows it is already planar and is passed through as is.
+// Returns a pooled I42A frame with the Y, U and V planes filled
+static struct obs_source_frame* ndi_source_split_uyva(struct ndi_source* s,
+	const NDIlib_video_frame_v2_t* video_frame)
 {
-	auto s = (struct ndi_source*)data;
+	const uint32_t width = (uint32_t)video_frame->xres;
+	const uint32_t height = (uint32_t)video_frame->yres;
+	if (width == 0 || height == 0 || (width & 1))
+		return nullptr;
 
-	blog(LOG_INFO, "A/V thread for '%s' started",
-						obs_source_get_name(s->source));
+	struct obs_source_frame* frame = frame_pool_get(&s->frame_pool,
+		VIDEO_FORMAT_I42A, width, height);
 
-	NDIlib_audio_frame_v2_t audio_frame;
-	obs_source_audio obs_audio_frame = {0};
-	NDIlib_video_frame_v2_t video_frame;
+	s->split_function(video_frame->p_data,
+		(uint32_t)video_frame->line_stride_in_bytes, width, 0, height,
+		frame->data, frame->linesize);
+	return frame;
+}
+#endif
+
+static void ndi_source_output_video(struct ndi_source* s,
+	const struct ndi_source_render_config& config,
+	const NDIlib_video_frame_v2_t* video_frame, uint64_t local_ts)
+{
 	obs_source_frame obs_video_frame = {0};
 
-	if (s->perf_token) {
-		os_end_high_performance(s->perf_token);
+	switch (video_frame->FourCC) {
+		case NDIlib_FourCC_type_BGRA:
+			obs_video_frame.format = VIDEO_FORMAT_BGRA;
+			break;
+
+		case NDIlib_FourCC_type_BGRX:
+			obs_video_frame.format = VIDEO_FORMAT_BGRX;
+			break;
+
+		case NDIlib_FourCC_type_RGBA:
+		case NDIlib_FourCC_type_RGBX:
+			obs_video_frame.format = VIDEO_FORMAT_RGBA;
+			break;
+
+		case NDIlib_FourCC_type_UYVY:
+			obs_video_frame.format = VIDEO_FORMAT_UYVY;
+			break;
+
+		case NDIlib_FourCC_type_UYVA:
+#if LIBOBS_API_VER >= MAKE_SEMANTIC_VERSION(26, 1, 0)
+			obs_video_frame.format = VIDEO_FORMAT_I42A;
+#else
+			obs_video_frame.format = VIDEO_FORMAT_UYVY;
+#endif
+			break;
+
+		case NDIlib_FourCC_type_I420:
+			obs_video_frame.format = VIDEO_FORMAT_I420;
+			break;
+
+		case NDIlib_FourCC_type_NV12:
+			obs_video_frame.format = VIDEO_FORMAT_NV12;
+			break;
+	}
+
+	// Frames pulled from the frame-synchronizer are already time-base
+	// corrected against the local clock. The jitter buffer maps and
+	// timestamps the frames it queues itself.
+	int sync_mode = config.framesync_enabled ?
+		PROP_SYNC_INTERNAL : config.sync_mode;
+	if (config.jitter_buffer_enabled)
+		sync_mode = PROP_SYNC_INTERNAL;
+
+	switch (sync_mode) {
+		case PROP_SYNC_INTERNAL:
+		default:
+			obs_video_frame.timestamp = local_ts;
+			break;
+
+		case PROP_SYNC_NDI_TIMESTAMP:
+			obs_video_frame.timestamp = ndi_source_map_time(s,
+				CLOCK_MAPPER_VIDEO, video_frame->timestamp, local_ts);
+			break;
+
+		case PROP_SYNC_NDI_SOURCE_TIMECODE:
+			obs_video_frame.timestamp = ndi_source_map_time(s,
+				CLOCK_MAPPER_VIDEO, video_frame->timecode, local_ts);
+			break;
 	}
-	s->perf_token = os_request_high_performance("NDI Receiver Thread");
-
-	NDIlib_frame_type_e frame_received = NDIlib_frame_type_none;
-	while (s->running) {
-		frame_received = ndiLib->NDIlib_recv_capture_v2(
-			s->ndi_receiver, &video_frame, &audio_frame, nullptr, 100);
-
-		if (frame_received == NDIlib_frame_type_audio) {
-			obs_audio_frame.speakers =
-				channel_count_to_layout(audio_frame.no_channels);
-
-			switch (s->sync_mode) {
-				case PROP_SYNC_INTERNAL:
-				default:
-					obs_audio_frame.timestamp = os_gettime_ns();
-					obs_audio_frame.timestamp +=
-						((uint64_t)audio_frame.no_samples * 1000000000ULL /
-							(uint64_t)audio_frame.sample_rate);
-					break;
-
-				case PROP_SYNC_NDI_TIMESTAMP:
-					obs_audio_frame.timestamp =
-						(uint64_t)(audio_frame.timestamp * 100.0);
-					break;
-
-				case PROP_SYNC_NDI_SOURCE_TIMECODE:
-					obs_audio_frame.timestamp =
-						(uint64_t)(audio_frame.timecode * 100.0);
-					break;
-			}
-
-			obs_audio_frame.samples_per_sec = audio_frame.sample_rate;
-			obs_audio_frame.format = AUDIO_FORMAT_FLOAT_PLANAR;
-			obs_audio_frame.frames = audio_frame.no_samples;
-
-			for (int i = 0; i < audio_frame.no_channels; ++i) {
-				obs_audio_frame.data[i] =
-					(uint8_t*)(&audio_frame.p_data[i * audio_frame.no_samples]);
-			}
-
-			obs_source_output_audio(s->source, &obs_audio_frame);
-			ndiLib->NDIlib_recv_free_audio_v2(s->ndi_receiver, &audio_frame);
-			continue;
-		}
 
-		if (frame_received == NDIlib_frame_type_video) {
-			switch (video_frame.FourCC) {
-				case NDIlib_FourCC_type_BGRA:
-					obs_video_frame.format = VIDEO_FORMAT_BGRA;
-					break;
-
-				case NDIlib_FourCC_type_BGRX:
-					obs_video_frame.format = VIDEO_FORMAT_BGRX;
-					break;
-
-				case NDIlib_FourCC_type_RGBA:
-				case NDIlib_FourCC_type_RGBX:
-					obs_video_frame.format = VIDEO_FORMAT_RGBA;
-					break;
-
-				case NDIlib_FourCC_type_UYVY:
-				case NDIlib_FourCC_type_UYVA:
-					obs_video_frame.format = VIDEO_FORMAT_UYVY;
-					break;
-
-				case NDIlib_FourCC_type_I420:
-					obs_video_frame.format = VIDEO_FORMAT_I420;
-					break;
-
-				case NDIlib_FourCC_type_NV12:
-					obs_video_frame.format = VIDEO_FORMAT_NV12;
-					break;
-			}
-
-			switch (s->sync_mode) {
-				case PROP_SYNC_INTERNAL:
-				default:
-					obs_video_frame.timestamp = os_gettime_ns();
-					break;
-
-				case PROP_SYNC_NDI_TIMESTAMP:
-					obs_video_frame.timestamp =
-						(uint64_t)(video_frame.timestamp * 100);
-					break;
-
-				case PROP_SYNC_NDI_SOURCE_TIMECODE:
-					obs_video_frame.timestamp =
-						(uint64_t)(video_frame.timecode * 100);
-					break;
-			}
-
-			obs_video_frame.width = video_frame.xres;
-			obs_video_frame.height = video_frame.yres;
-			obs_video_frame.linesize[0] = video_frame.line_stride_in_bytes;
-			obs_video_frame.data[0] = video_frame.p_data;
-
-			video_format_get_parameters(s->yuv_colorspace, s->yuv_range,
-				obs_video_frame.color_matrix, obs_video_frame.color_range_min,
-				obs_video_frame.color_range_max);
-
-			obs_source_output_video(s->source, &obs_video_frame);
-			ndiLib->NDIlib_recv_free_video_v2(s->ndi_receiver, &video_frame);
-			continue;
+	obs_video_frame.width = video_frame->xres;
+	obs_video_frame.height = video_frame->yres;
+
+	// Converted planes go straight from the pooled frame to OBS, or to
+	// the jitter buffer. The alpha plane that follows the UYVY data of a
+	// UYVA frame is already planar and is used as is.
+	struct obs_source_frame* converted = nullptr;
+#if LIBOBS_API_VER >= MAKE_SEMANTIC_VERSION(26, 1, 0)
+	if (obs_video_frame.format == VIDEO_FORMAT_I42A) {
+		converted = ndi_source_split_uyva(s, video_frame);
+		if (!converted)
+			return;
+
+		for (int i = 0; i < 3; ++i) {
+			obs_video_frame.data[i] = converted->data[i];
+			obs_video_frame.linesize[i] = converted->linesize[i];
 		}
+		obs_video_frame.data[3] = video_frame->p_data +
+			(size_t)video_frame->line_stride_in_bytes * video_frame->yres;
+		obs_video_frame.linesize[3] = video_frame->xres;
+	} else
+#endif
+	{
+		obs_video_frame.linesize[0] = video_frame->line_stride_in_bytes;
+		obs_video_frame.data[0] = video_frame->p_data;
+	}
 
-		if (ndiLib->NDIlib_recv_get_no_connections(s->ndi_receiver) == 0) {
-			std::this_thread::sleep_for(std::chrono::milliseconds(100));
-			continue;
-		}
+	video_format_get_parameters(config.yuv_colorspace, config.yuv_range,
+		obs_video_frame.color_matrix, obs_video_frame.color_range_min,
+		obs_video_frame.color_range_max);
+
+	if (config.jitter_buffer_enabled) {
+		struct obs_source_frame* frame = converted ? converted :
+			frame_pool_get(&s->frame_pool, obs_video_frame.format,
+				obs_video_frame.width, obs_video_frame.height);
+		frame_pool_copy_to(&s->frame_pool, frame, &obs_video_frame);
+		converted = nullptr;
+
+		jitter_buffer_push(&s->jitter_buffer, frame,
+			ndi_source_jitter_time(config, video_frame->timestamp,
+				video_frame->timecode),
+			local_ts);
+	} else {
+		ndi_source_output_frame(s, &obs_video_frame);
 	}
 
-	os_end_high_performance(s->perf_token);
-	s->perf_token = NULL;
+	frame_pool_release(&s->frame_pool, converted);
 
-	blog(LOG_INFO, "audio thread for '%s' completed",
-				obs_source_get_name(s->source));
-	return nullptr;
+	ndi_source_measure_video(s, video_frame, local_ts);
 }
 
-void ndi_source_update(void* data, obs_data_t* settings)
+static void ndi_source_received_video(void* data,
+	NDIlib_video_frame_v2_t* video_frame, uint64_t local_ts)
 {
 	auto s = (struct ndi_source*)data;
+	const struct ndi_source_render_config config = load_render_config(s);
+
+	if (video_frame->frame_format_type ==
+		NDIlib_frame_format_type_progressive)
+	{
+		ndi_source_output_video(s, config, video_frame, local_ts);
+		return;
+	}
 
-	if(s->running) {
-		s->running = false;
-		pthread_join(s->av_thread, NULL);
+	struct deinterlaced_frame frames[2];
+	int count = deinterlacer_process(&s->deinterlacer, config.deinterlace,
+		video_frame, frames);
+	for (int i = 0; i < count; ++i) {
+		ndi_source_output_video(s, config, &frames[i].frame,
+			local_ts + frames[i].delay_ns);
 	}
-	s->running = false;
-	ndiLib->NDIlib_recv_destroy(s->ndi_receiver);
+}
+
+static void ndi_source_received_audio(void* data,
+	NDIlib_audio_frame_v2_t* audio_frame, uint64_t local_ts)
+{
+	auto s = (struct ndi_source*)data;
+	const struct ndi_source_render_config config = load_render_config(s);
+	obs_source_audio obs_audio_frame = {0};
 
-	bool hwAccelEnabled = obs_data_get_bool(settings, PROP_HW_ACCEL);
+	if (!audio_remap_process(&s->audio_remap,
+		config.audio_downmix ?
+			AUDIO_MAPPING_DOWNMIX_STEREO : AUDIO_MAPPING_ROUTE,
+		audio_frame, (const uint8_t**)obs_audio_frame.data,
+		&obs_audio_frame.speakers))
+		return;
+
+	// The jitter buffer maps the timestamps of the audio itself, to play
+	// it as late as it outputs the matching video
+	const int sync_mode = config.jitter_buffer_enabled ?
+		PROP_SYNC_INTERNAL : config.sync_mode;
+
+	switch (sync_mode) {
+		case PROP_SYNC_INTERNAL:
+		default:
+			obs_audio_frame.timestamp = local_ts;
+			obs_audio_frame.timestamp +=
+				((uint64_t)audio_frame->no_samples * 1000000000ULL /
+					(uint64_t)audio_frame->sample_rate);
+			break;
+
+		case PROP_SYNC_NDI_TIMESTAMP:
+			obs_audio_frame.timestamp = ndi_source_map_time(s,
+				CLOCK_MAPPER_AUDIO, audio_frame->timestamp, local_ts);
+			break;
+
+		case PROP_SYNC_NDI_SOURCE_TIMECODE:
+			obs_audio_frame.timestamp = ndi_source_map_time(s,
+				CLOCK_MAPPER_AUDIO, audio_frame->timecode, local_ts);
+			break;
+	}
+
+	// Audio pulled from the frame-synchronizer is paced by the local clock
+	if (config.framesync_enabled) {
+		obs_audio_frame.timestamp = local_ts;
+	}
+
+	if (config.jitter_buffer_enabled) {
+		obs_audio_frame.timestamp = jitter_buffer_audio_due(
+			&s->jitter_buffer,
+			ndi_source_jitter_time(config, audio_frame->timestamp,
+				audio_frame->timecode),
+			local_ts);
+	}
+
+	obs_audio_frame.samples_per_sec = audio_frame->sample_rate;
+	obs_audio_frame.format = AUDIO_FORMAT_FLOAT_PLANAR;
+	obs_audio_frame.frames = audio_frame->no_samples;
+
+	obs_source_output_audio(s->source, &obs_audio_frame);
+}
+
+void ndi_source_update(void* data, obs_data_t* settings)
+{
+	auto s = (struct ndi_source*)data;
 
 	s->alpha_filter_enabled =
 		obs_data_get_bool(settings, PROP_FIX_ALPHA);
@@ -453,107 +913,265 @@ void ndi_source_update(void* data, obs_data_t* settings)
 		}
 	}
 
-	NDIlib_recv_create_v3_t recv_desc;
-	recv_desc.source_to_connect_to.p_ndi_name = obs_data_get_string(settings, PROP_SOURCE);
-	recv_desc.allow_video_fields = true;
-	recv_desc.color_format = NDIlib_recv_color_format_UYVY_BGRA;
+	struct ndi_receiver_config config;
+	config.ndi_name = obs_data_get_string(settings, PROP_SOURCE);
+	config.framesync = obs_data_get_bool(settings, PROP_FRAMESYNC);
+	config.hw_accel = obs_data_get_bool(settings, PROP_HW_ACCEL);
 
-	switch (obs_data_get_int(settings, PROP_BANDWIDTH)) {
+	struct ndi_source_render_config render_config;
+	render_config.audio_only = false;
+	const int bandwidth_mode = (int)obs_data_get_int(settings, PROP_BANDWIDTH);
+	switch (bandwidth_mode) {
 		case PROP_BW_HIGHEST:
 		default:
-			recv_desc.bandwidth = NDIlib_recv_bandwidth_highest;
+			config.bandwidth = NDIlib_recv_bandwidth_highest;
 			break;
 		case PROP_BW_LOWEST:
-			recv_desc.bandwidth = NDIlib_recv_bandwidth_lowest;
+			config.bandwidth = NDIlib_recv_bandwidth_lowest;
 			break;
 		case PROP_BW_AUDIO_ONLY:
-			recv_desc.bandwidth = NDIlib_recv_bandwidth_audio_only;
+			config.bandwidth = NDIlib_recv_bandwidth_audio_only;
+			render_config.audio_only = true;
 			obs_source_output_video(s->source, blank_video_frame());
 			break;
+		case PROP_BW_AUTO:
+			config.bandwidth = (obs_source_showing(s->source) ||
+				obs_source_active(s->source)) ?
+				NDIlib_recv_bandwidth_highest :
+				NDIlib_recv_bandwidth_lowest;
+			break;
 	}
 
-	s->sync_mode = (int)obs_data_get_int(settings, PROP_SYNC);
-	s->yuv_range =
+	render_config.framesync_enabled = config.framesync;
+	render_config.sync_mode = (int)obs_data_get_int(settings, PROP_SYNC);
+	render_config.yuv_range =
 		prop_to_range_type((int)obs_data_get_int(settings, PROP_YUV_RANGE));
-	s->yuv_colorspace =
+	render_config.yuv_colorspace =
 		prop_to_colorspace((int)obs_data_get_int(settings, PROP_YUV_COLORSPACE));
 
-	const bool is_unbuffered =
+	// The frame-synchronizer does its own buffering: OBS must display
+	// each pulled frame as soon as it is output. In low latency mode, our
+	// own jitter buffer (if any) replaces OBS's.
+	const bool low_latency =
 		(obs_data_get_int(settings, PROP_LATENCY) == PROP_LATENCY_LOW);
-	obs_source_set_async_unbuffered(s->source, is_unbuffered);
-
-	s->ndi_receiver = ndiLib->NDIlib_recv_create_v3(&recv_desc);
-	if (s->ndi_receiver) {
-		if (hwAccelEnabled) {
-			NDIlib_metadata_frame_t hwAccelMetadata;
-			hwAccelMetadata.p_data = (char*)"<ndi_hwaccel enabled=\"true\"/>";
-			ndiLib->NDIlib_recv_send_metadata(
-				s->ndi_receiver, &hwAccelMetadata);
-		}
+	const uint32_t jitter_buffer_max =
+		(uint32_t)obs_data_get_int(settings, PROP_JITTER_BUFFER_MAX);
+
+	render_config.audio_downmix =
+		(obs_data_get_int(settings, PROP_AUDIO_MAPPING) ==
+			AUDIO_MAPPING_DOWNMIX_STEREO);
+	render_config.deinterlace =
+		(enum deinterlace_mode)obs_data_get_int(settings, PROP_DEINTERLACE);
+	render_config.jitter_buffer_enabled =
+		low_latency && !config.framesync && jitter_buffer_max > 0;
+	jitter_buffer_set_max_depth(&s->jitter_buffer, jitter_buffer_max);
+
+	// Takes effect from the next received frame, on the running receiver
+	const struct ndi_source_render_config previous_config =
+		load_render_config(s);
+	if (previous_config.sync_mode != render_config.sync_mode) {
+		clock_mapper_reset(&s->clock);
+	}
+	os_atomic_set_long(&s->render_config, pack_render_config(&render_config));
 
-		s->running = true;
-		pthread_create(&s->av_thread, nullptr, ndi_source_poll_audio_video, data);
+	if (previous_config.jitter_buffer_enabled &&
+		!render_config.jitter_buffer_enabled)
+	{
+		jitter_buffer_clear(&s->jitter_buffer);
+	}
 
-		blog(LOG_INFO, "started A/V threads for source '%s'",
-			recv_desc.source_to_connect_to.p_ndi_name);
+	obs_source_set_async_unbuffered(s->source,
+		config.framesync || low_latency);
 
-		// Update tally status
-		s->tally.on_preview = obs_source_showing(s->source);
-		s->tally.on_program = obs_source_active(s->source);
-		ndiLib->NDIlib_recv_set_tally(s->ndi_receiver, &s->tally);
-	} else {
-		blog(LOG_ERROR,
-			"can't create a receiver for NDI source '%s'",
-			recv_desc.source_to_connect_to.p_ndi_name);
+	s->tally.on_preview = obs_source_showing(s->source);
+	s->tally.on_program = obs_source_active(s->source);
+	ndi_receiver_set_tally(s->subscriber, &s->tally);
+
+	pthread_mutex_lock(&s->connect_mutex);
+	if (!s->connect_config.ndi_name ||
+		strcmp(s->connect_config.ndi_name, config.ndi_name) != 0)
+	{
+		clock_mapper_reset(&s->clock);
 	}
+	bfree((void*)s->connect_config.ndi_name);
+	s->connect_config = config;
+	s->connect_config.ndi_name = bstrdup(config.ndi_name);
+	s->bandwidth_auto = (bandwidth_mode == PROP_BW_AUTO);
+	s->off_air_time = 0.0f;
+
+	// Doesn't block: a no-op when no connection setting changed, otherwise
+	// the receiver is switched or retargeted in the background
+	ndi_receiver_connect(s->subscriber, &s->connect_config);
+	pthread_mutex_unlock(&s->connect_mutex);
 }
 
-void ndi_source_shown(void* data)
+// Automatic bandwidth mode: the full stream when shown, and the sender's
+// low-bandwidth proxy stream otherwise. Being shown includes the studio
+// mode preview, so that the full stream is already up, past the receiver's
+// make-before-break switch, by the time the source is cut to program.
+// Going back to the proxy only happens once the source has been neither
+// shown nor on program for a while.
+static void ndi_source_update_auto_bandwidth(struct ndi_source* s,
+	bool on_air, float seconds)
 {
-	auto s = (struct ndi_source*)data;
+	pthread_mutex_lock(&s->connect_mutex);
+
+	if (s->bandwidth_auto) {
+		NDIlib_recv_bandwidth_e bandwidth = s->connect_config.bandwidth;
+		if (on_air) {
+			s->off_air_time = 0.0f;
+			bandwidth = NDIlib_recv_bandwidth_highest;
+		} else {
+			s->off_air_time += seconds;
+			if (s->off_air_time >= AUTO_BANDWIDTH_HOLD_TIME)
+				bandwidth = NDIlib_recv_bandwidth_lowest;
+		}
 
-	if (s->ndi_receiver) {
-		s->tally.on_preview = true;
-		ndiLib->NDIlib_recv_set_tally(s->ndi_receiver, &s->tally);
+		if (bandwidth != s->connect_config.bandwidth) {
+			blog(LOG_INFO, "[NDI Source '%s'] switching to %s bandwidth",
+				obs_source_get_name(s->source),
+				on_air ? "highest" : "lowest");
+
+			s->connect_config.bandwidth = bandwidth;
+			ndi_receiver_connect(s->subscriber, &s->connect_config);
+		}
 	}
+
+	pthread_mutex_unlock(&s->connect_mutex);
 }
 
-void ndi_source_hidden(void* data)
+void ndi_source_tick(void* data, float seconds)
 {
 	auto s = (struct ndi_source*)data;
+	const struct ndi_source_render_config config = load_render_config(s);
+
+	s->stats_sample_elapsed += seconds;
+	if (s->stats_sample_elapsed >= STATS_SAMPLE_INTERVAL) {
+		s->stats_sample_elapsed = 0.0f;
+		ndi_source_sample_stats(s);
+	}
 
-	if (s->ndi_receiver) {
-		s->tally.on_preview = false;
-		ndiLib->NDIlib_recv_set_tally(s->ndi_receiver, &s->tally);
+	s->stats_log_elapsed += seconds;
+	if (s->stats_log_elapsed >= STATS_LOG_INTERVAL) {
+		s->stats_log_elapsed = 0.0f;
+		ndi_source_log_stats(s);
+	}
+
+	ndi_source_update_auto_bandwidth(s,
+		s->tally.on_preview || s->tally.on_program, seconds);
+
+	if (config.jitter_buffer_enabled) {
+		struct obs_source_frame* frame =
+			jitter_buffer_pop(&s->jitter_buffer, os_gettime_ns());
+		if (frame) {
+			ndi_source_output_frame(s, frame);
+			frame_pool_release(&s->frame_pool, frame);
+		}
 	}
+
+	// Frames pulled while not shown would be thrown away
+	if (!config.framesync_enabled || config.audio_only ||
+		!s->tally.on_preview)
+		return;
+
+	// Pull exactly one frame per OBS frame
+	ndi_receiver_pull_framesync_video(s->subscriber);
 }
 
-void ndi_source_activated(void* data)
+static void ndi_source_update_tally(struct ndi_source* s)
+{
+	ndi_receiver_set_tally(s->subscriber, &s->tally);
+}
+
+void ndi_source_shown(void* data)
 {
 	auto s = (struct ndi_source*)data;
+	s->tally.on_preview = true;
+	ndi_source_update_tally(s);
+	ndi_source_update_auto_bandwidth(s, true, 0.0f);
+}
 
-	if (s->ndi_receiver) {
-		s->tally.on_program = true;
-		ndiLib->NDIlib_recv_set_tally(s->ndi_receiver, &s->tally);
-	}
+void ndi_source_hidden(void* data)
+{
+	auto s = (struct ndi_source*)data;
+	s->tally.on_preview = false;
+	ndi_source_update_tally(s);
 }
 
-void ndi_source_deactivated(void* data)
+void ndi_source_activated(void* data)
 {
 	auto s = (struct ndi_source*)data;
+	s->tally.on_program = true;
+	ndi_source_update_tally(s);
+	ndi_source_update_auto_bandwidth(s, true, 0.0f);
+}
 
-	if (s->ndi_receiver) {
-		s->tally.on_program = false;
-		ndiLib->NDIlib_recv_set_tally(s->ndi_receiver, &s->tally);
-	}
+void ndi_source_deactivated(void* data)
+{
+	auto s = (struct ndi_source*)data;
+	s->tally.on_program = false;
+	ndi_source_update_tally(s);
 }
 
 void* ndi_source_create(obs_data_t* settings, obs_source_t* source)
 {
 	auto s = (struct ndi_source*)bzalloc(sizeof(struct ndi_source));
 	s->source = source;
-	s->running = false;
-	s->perf_token = NULL;
+	s->subscriber = ndi_receiver_subscriber_create(s,
+		ndi_source_received_video, ndi_source_received_audio);
+	clock_mapper_init(&s->clock);
+	frame_pool_init(&s->frame_pool);
+	jitter_buffer_init(&s->jitter_buffer, &s->clock, &s->frame_pool);
+	audio_remap_init(&s->audio_remap);
+	deinterlacer_init(&s->deinterlacer);
+#if LIBOBS_API_VER >= MAKE_SEMANTIC_VERSION(26, 1, 0)
+	s->split_function = get_uyvy_to_i422_function(nullptr);
+#endif
+	pthread_mutex_init(&s->connect_mutex, NULL);
+	pthread_mutex_init(&s->stats_mutex, NULL);
+
+	proc_handler_t* ph = obs_source_get_proc_handler(source);
+	proc_handler_add(ph, "void get_ndi_stats(out bool connected, "
+		"out int video_frames, out int dropped_video_frames, "
+		"out int video_queue, out int audio_frames, "
+		"out int dropped_audio_frames, out int audio_queue, "
+		"out float latency_ms, out float jitter_ms, "
+		"out int jitter_buffer_ms, out int jitter_buffer_late, "
+		"out int jitter_buffer_dropped, out int frame_allocations, "
+		"out int frames_output, out int bytes_copied)",
+		[](void* data, calldata_t* cd) {
+			auto s = (struct ndi_source*)data;
+			const struct ndi_source_stats stats = ndi_source_get_stats(s);
+
+			calldata_set_bool(cd, "connected", stats.connected);
+			calldata_set_int(cd, "video_frames",
+				stats.receiver.video_frames);
+			calldata_set_int(cd, "dropped_video_frames",
+				stats.receiver.dropped_video_frames);
+			calldata_set_int(cd, "video_queue",
+				stats.receiver.video_queue);
+			calldata_set_int(cd, "audio_frames",
+				stats.receiver.audio_frames);
+			calldata_set_int(cd, "dropped_audio_frames",
+				stats.receiver.dropped_audio_frames);
+			calldata_set_int(cd, "audio_queue",
+				stats.receiver.audio_queue);
+			calldata_set_float(cd, "latency_ms", stats.latency_ms);
+			calldata_set_float(cd, "jitter_ms", stats.jitter_ms);
+			calldata_set_int(cd, "jitter_buffer_ms",
+				stats.jitter_buffer.depth_ms);
+			calldata_set_int(cd, "jitter_buffer_late",
+				(long long)stats.jitter_buffer.late);
+			calldata_set_int(cd, "jitter_buffer_dropped",
+				(long long)stats.jitter_buffer.dropped);
+			calldata_set_int(cd, "frame_allocations",
+				(long long)stats.frame_pool.allocations);
+			calldata_set_int(cd, "frames_output",
+				stats.frames_output);
+			calldata_set_int(cd, "bytes_copied",
+				(long long)stats.frame_pool.bytes_copied);
+		}, s);
+
 	ndi_source_update(s, settings);
 	return s;
 }
@@ -561,9 +1179,15 @@ void* ndi_source_create(obs_data_t* settings, obs_source_t* source)
 void ndi_source_destroy(void* data)
 {
 	auto s = (struct ndi_source*)data;
-	s->running = false;
-	pthread_join(s->av_thread, NULL);
-	ndiLib->NDIlib_recv_destroy(s->ndi_receiver);
+	ndi_receiver_subscriber_destroy(s->subscriber);
+	bfree((void*)s->connect_config.ndi_name);
+	pthread_mutex_destroy(&s->connect_mutex);
+	clock_mapper_free(&s->clock);
+	jitter_buffer_free(&s->jitter_buffer);
+	frame_pool_free(&s->frame_pool);
+	audio_remap_free(&s->audio_remap);
+	deinterlacer_free(&s->deinterlacer);
+	pthread_mutex_destroy(&s->stats_mutex);
 	bfree(s);
 }
 
@@ -578,6 +1202,7 @@ struct obs_source_info create_ndi_source_info()
 	ndi_source_info.get_properties	= ndi_source_getproperties;
 	ndi_source_info.get_defaults	= ndi_source_getdefaults;
 	ndi_source_info.update			= ndi_source_update;
+	ndi_source_info.video_tick		= ndi_source_tick;
 	ndi_source_info.show			= ndi_source_shown;
 	ndi_source_info.hide			= ndi_source_hidden;
 	ndi_source_info.activate		= ndi_source_activated;
@@ -39,6 +39,10 @@ along with this program; If not, see <https://www.gnu.org/licenses/>
 #include "main-output.h"
 #include "preview-output.h"
 #include "Config.h"
+#include "connection-monitor.h"
+#include "ndi-receiver.h"
+#include "ndi-discovery.h"
+#include "readback-scheduler.h"
 #include "forms/output-settings.h"
 
 OBS_DECLARE_MODULE()
@@ -67,8 +71,6 @@ const NDIlib_v3* load_ndilib();
 typedef const NDIlib_v3* (*NDIlib_v3_load_)(void);
 QLibrary* loaded_lib = nullptr;
 
-NDIlib_find_instance_t ndi_finder;
-
 OutputSettings* output_settings;
 
 bool obs_module_load(void)
@@ -107,10 +109,11 @@ bool obs_module_load(void)
 
 	blog(LOG_INFO, "NDI library initialized successfully (%s)", ndiLib->NDIlib_version());
 
-	NDIlib_find_create_t find_desc = {0};
-	find_desc.show_local_sources = true;
-	find_desc.p_groups = NULL;
-	ndi_finder = ndiLib->NDIlib_find_create_v2(&find_desc);
+	ndi_discovery_start();
+
+	connection_monitor_init();
+	ndi_receiver_registry_init();
+	readback_scheduler_init();
 
 	ndi_source_info = create_ndi_source_info();
 	obs_register_source(&ndi_source_info);
@@ -175,7 +178,10 @@ void obs_module_unload()
 	blog(LOG_INFO, "goodbye !");
 
 	if (ndiLib) {
-		ndiLib->NDIlib_find_destroy(ndi_finder);
+		readback_scheduler_deinit();
+		connection_monitor_deinit();
+		ndi_receiver_registry_deinit();
+		ndi_discovery_stop();
 		ndiLib->NDIlib_destroy();
 	}
 
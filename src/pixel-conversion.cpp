@@ -0,0 +1,521 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "pixel-conversion.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CONV_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define CONV_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#define TARGET_AVX2
+#define TARGET_SSE2
+#endif
+
+// Output rows hold two bytes per pixel
+static inline uint32_t uyvy_width(uint32_t out_linesize)
+{
+	return out_linesize / 2;
+}
+
+static inline void i444_to_uyvy_row_scalar(const uint8_t* _Y,
+	const uint8_t* _U, const uint8_t* _V, uint8_t* _out,
+	uint32_t start_x, uint32_t width)
+{
+	uint32_t x = start_x;
+	for (; x + 1 < width; x += 2) {
+		*(_out++) = (uint8_t)((_U[x] + _U[x + 1] + 1) >> 1);
+		*(_out++) = _Y[x];
+		*(_out++) = (uint8_t)((_V[x] + _V[x + 1] + 1) >> 1);
+		*(_out++) = _Y[x + 1];
+	}
+
+	// An odd width leaves one pixel, and two bytes of room in the row:
+	// its own chroma and luma, without a second pixel to pair it with
+	if (x < width) {
+		*(_out++) = _U[x];
+		*(_out++) = _Y[x];
+	}
+}
+
+void convert_i444_to_uyvy_ref(uint8_t* input[], uint32_t in_linesize[],
+						  uint32_t start_y, uint32_t end_y,
+						  uint8_t* output, uint32_t out_linesize)
+{
+	uint32_t width = uyvy_width(out_linesize);
+	for (uint32_t y = start_y; y < end_y; ++y) {
+		i444_to_uyvy_row_scalar(
+			input[0] + (y * in_linesize[0]),
+			input[1] + (y * in_linesize[1]),
+			input[2] + (y * in_linesize[2]),
+			output + (y * out_linesize),
+			0, width);
+	}
+}
+
+static inline uint8_t pack_unorm(const float vec[4], float r, float g,
+	float b)
+{
+	float value = vec[0] * r + vec[1] * g + vec[2] * b + vec[3];
+	if (value < 0.0f)
+		value = 0.0f;
+	else if (value > 1.0f)
+		value = 1.0f;
+	return (uint8_t)(value * 255.0f + 0.5f);
+}
+
+void pack_bgra_to_uyvy_ref(const uint8_t* input, uint32_t in_linesize,
+	uint32_t width, uint32_t height, const float color_vecs[3][4],
+	bool alpha, uint8_t* output, uint32_t out_linesize)
+{
+	const float scale = 1.0f / 255.0f;
+
+	for (uint32_t y = 0; y < height; ++y) {
+		const uint8_t* _in = input + (y * in_linesize);
+		uint8_t* _out = output + (y * out_linesize);
+
+		for (uint32_t x = 0; x + 1 < width; x += 2) {
+			const uint8_t* p0 = _in + (x * 4);
+			const uint8_t* p1 = p0 + 4;
+
+			float r0 = p0[2] * scale, g0 = p0[1] * scale, b0 = p0[0] * scale;
+			float r1 = p1[2] * scale, g1 = p1[1] * scale, b1 = p1[0] * scale;
+			float r = (r0 + r1) * 0.5f;
+			float g = (g0 + g1) * 0.5f;
+			float b = (b0 + b1) * 0.5f;
+
+			*(_out++) = pack_unorm(color_vecs[1], r, g, b);
+			*(_out++) = pack_unorm(color_vecs[0], r0, g0, b0);
+			*(_out++) = pack_unorm(color_vecs[2], r, g, b);
+			*(_out++) = pack_unorm(color_vecs[0], r1, g1, b1);
+		}
+	}
+
+	if (!alpha)
+		return;
+
+	uint8_t* _alpha = output + (height * out_linesize);
+	const uint32_t alpha_linesize = out_linesize / 2;
+	for (uint32_t y = 0; y < height; ++y) {
+		const uint8_t* _in = input + (y * in_linesize);
+		uint8_t* _out = _alpha + (y * alpha_linesize);
+		for (uint32_t x = 0; x < width; ++x)
+			_out[x] = _in[(x * 4) + 3];
+	}
+}
+
+static inline void uyvy_to_i422_row_scalar(const uint8_t* _in,
+	uint8_t* _Y, uint8_t* _U, uint8_t* _V, uint32_t start_x, uint32_t width)
+{
+	for (uint32_t x = start_x; x < width; x += 2) {
+		const uint8_t* pair = _in + (x * 2);
+		_U[x / 2] = pair[0];
+		_Y[x] = pair[1];
+		_V[x / 2] = pair[2];
+		_Y[x + 1] = pair[3];
+	}
+}
+
+void split_uyvy_to_i422_ref(const uint8_t* input, uint32_t in_linesize,
+						  uint32_t width, uint32_t start_y, uint32_t end_y,
+						  uint8_t* output[], uint32_t out_linesize[])
+{
+	for (uint32_t y = start_y; y < end_y; ++y) {
+		uyvy_to_i422_row_scalar(
+			input + (y * in_linesize),
+			output[0] + (y * out_linesize[0]),
+			output[1] + (y * out_linesize[1]),
+			output[2] + (y * out_linesize[2]),
+			0, width);
+	}
+}
+
+static inline void interpolate_field_line_scalar(const uint8_t* above,
+	const uint8_t* below, const uint8_t* other, uint8_t* output,
+	size_t start, size_t size, uint8_t threshold)
+{
+	for (size_t i = start; i < size; ++i) {
+		uint8_t avg = (uint8_t)((above[i] + below[i] + 1) >> 1);
+		if (other) {
+			int diff = (int)other[i] - (int)avg;
+			if (diff <= threshold && -diff <= threshold)
+				avg = other[i];
+		}
+		output[i] = avg;
+	}
+}
+
+void interpolate_field_line_ref(const uint8_t* above, const uint8_t* below,
+	const uint8_t* other, uint8_t* output, size_t size, uint8_t threshold)
+{
+	interpolate_field_line_scalar(above, below, other, output, 0, size,
+		threshold);
+}
+
+#ifdef CONV_X86
+
+// 16 bytes per iteration. avg_epu8 rounds up like the scalar version.
+TARGET_SSE2
+static void interpolate_field_line_sse2(const uint8_t* above,
+	const uint8_t* below, const uint8_t* other, uint8_t* output,
+	size_t size, uint8_t threshold)
+{
+	const __m128i thres = _mm_set1_epi8((char)threshold);
+	const __m128i zero = _mm_setzero_si128();
+	size_t simd_size = size & ~(size_t)15;
+
+	for (size_t i = 0; i < simd_size; i += 16) {
+		__m128i avg = _mm_avg_epu8(
+			_mm_loadu_si128((const __m128i*)(above + i)),
+			_mm_loadu_si128((const __m128i*)(below + i)));
+
+		if (other) {
+			__m128i o = _mm_loadu_si128((const __m128i*)(other + i));
+			__m128i diff = _mm_or_si128(_mm_subs_epu8(o, avg),
+				_mm_subs_epu8(avg, o));
+			__m128i still = _mm_cmpeq_epi8(
+				_mm_subs_epu8(diff, thres), zero);
+			avg = _mm_or_si128(_mm_and_si128(still, o),
+				_mm_andnot_si128(still, avg));
+		}
+
+		_mm_storeu_si128((__m128i*)(output + i), avg);
+	}
+
+	interpolate_field_line_scalar(above, below, other, output, simd_size,
+		size, threshold);
+}
+
+// 16 pixels per iteration: luma is the high byte of each 16-bit lane and
+// chroma the low one. Chroma is packed once more to split U from V.
+TARGET_SSE2
+static void split_uyvy_to_i422_sse2(const uint8_t* input, uint32_t in_linesize,
+						  uint32_t width, uint32_t start_y, uint32_t end_y,
+						  uint8_t* output[], uint32_t out_linesize[])
+{
+	const __m128i lo_mask = _mm_set1_epi16(0x00FF);
+	const __m128i zero = _mm_setzero_si128();
+	uint32_t simd_width = width & ~15u;
+
+	for (uint32_t y = start_y; y < end_y; ++y) {
+		const uint8_t* _in = input + (y * in_linesize);
+		uint8_t* _Y = output[0] + (y * out_linesize[0]);
+		uint8_t* _U = output[1] + (y * out_linesize[1]);
+		uint8_t* _V = output[2] + (y * out_linesize[2]);
+
+		for (uint32_t x = 0; x < simd_width; x += 16) {
+			__m128i a = _mm_loadu_si128((const __m128i*)(_in + (x * 2)));
+			__m128i b = _mm_loadu_si128((const __m128i*)(_in + (x * 2) + 16));
+
+			_mm_storeu_si128((__m128i*)(_Y + x), _mm_packus_epi16(
+				_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+
+			__m128i uv = _mm_packus_epi16(_mm_and_si128(a, lo_mask),
+				_mm_and_si128(b, lo_mask));
+
+			_mm_storel_epi64((__m128i*)(_U + (x / 2)), _mm_packus_epi16(
+				_mm_and_si128(uv, lo_mask), zero));
+			_mm_storel_epi64((__m128i*)(_V + (x / 2)), _mm_packus_epi16(
+				_mm_srli_epi16(uv, 8), zero));
+		}
+
+		uyvy_to_i422_row_scalar(_in, _Y, _U, _V, simd_width, width);
+	}
+}
+
+// 16 pixels per iteration: pairs of chroma samples are averaged as 16-bit
+// lanes, packed back as U/V byte pairs and interleaved with luma.
+TARGET_SSE2
+static void convert_i444_to_uyvy_sse2(uint8_t* input[], uint32_t in_linesize[],
+						  uint32_t start_y, uint32_t end_y,
+						  uint8_t* output, uint32_t out_linesize)
+{
+	const __m128i lo_mask = _mm_set1_epi16(0x00FF);
+	uint32_t width = uyvy_width(out_linesize);
+	uint32_t simd_width = width & ~15u;
+
+	for (uint32_t y = start_y; y < end_y; ++y) {
+		const uint8_t* _Y = input[0] + (y * in_linesize[0]);
+		const uint8_t* _U = input[1] + (y * in_linesize[1]);
+		const uint8_t* _V = input[2] + (y * in_linesize[2]);
+		uint8_t* _out = output + (y * out_linesize);
+
+		for (uint32_t x = 0; x < simd_width; x += 16) {
+			__m128i luma = _mm_loadu_si128((const __m128i*)(_Y + x));
+			__m128i u = _mm_loadu_si128((const __m128i*)(_U + x));
+			__m128i v = _mm_loadu_si128((const __m128i*)(_V + x));
+
+			u = _mm_avg_epu16(_mm_and_si128(u, lo_mask),
+				_mm_srli_epi16(u, 8));
+			v = _mm_avg_epu16(_mm_and_si128(v, lo_mask),
+				_mm_srli_epi16(v, 8));
+			__m128i uv = _mm_or_si128(u, _mm_slli_epi16(v, 8));
+
+			_mm_storeu_si128((__m128i*)(_out + (x * 2)),
+				_mm_unpacklo_epi8(uv, luma));
+			_mm_storeu_si128((__m128i*)(_out + (x * 2) + 16),
+				_mm_unpackhi_epi8(uv, luma));
+		}
+
+		i444_to_uyvy_row_scalar(_Y, _U, _V, _out + (simd_width * 2),
+			simd_width, width);
+	}
+}
+
+// Same as the SSE2 variant, 32 pixels at a time. Unpacks work within
+// 128-bit lanes, so the two halves are put back in order before storing.
+TARGET_AVX2
+static void convert_i444_to_uyvy_avx2(uint8_t* input[], uint32_t in_linesize[],
+						  uint32_t start_y, uint32_t end_y,
+						  uint8_t* output, uint32_t out_linesize)
+{
+	const __m256i lo_mask = _mm256_set1_epi16(0x00FF);
+	uint32_t width = uyvy_width(out_linesize);
+	uint32_t simd_width = width & ~31u;
+
+	for (uint32_t y = start_y; y < end_y; ++y) {
+		const uint8_t* _Y = input[0] + (y * in_linesize[0]);
+		const uint8_t* _U = input[1] + (y * in_linesize[1]);
+		const uint8_t* _V = input[2] + (y * in_linesize[2]);
+		uint8_t* _out = output + (y * out_linesize);
+
+		for (uint32_t x = 0; x < simd_width; x += 32) {
+			__m256i luma = _mm256_loadu_si256((const __m256i*)(_Y + x));
+			__m256i u = _mm256_loadu_si256((const __m256i*)(_U + x));
+			__m256i v = _mm256_loadu_si256((const __m256i*)(_V + x));
+
+			u = _mm256_avg_epu16(_mm256_and_si256(u, lo_mask),
+				_mm256_srli_epi16(u, 8));
+			v = _mm256_avg_epu16(_mm256_and_si256(v, lo_mask),
+				_mm256_srli_epi16(v, 8));
+			__m256i uv = _mm256_or_si256(u, _mm256_slli_epi16(v, 8));
+
+			__m256i lo = _mm256_unpacklo_epi8(uv, luma);
+			__m256i hi = _mm256_unpackhi_epi8(uv, luma);
+
+			_mm256_storeu_si256((__m256i*)(_out + (x * 2)),
+				_mm256_permute2x128_si256(lo, hi, 0x20));
+			_mm256_storeu_si256((__m256i*)(_out + (x * 2) + 32),
+				_mm256_permute2x128_si256(lo, hi, 0x31));
+		}
+
+		i444_to_uyvy_row_scalar(_Y, _U, _V, _out + (simd_width * 2),
+			simd_width, width);
+	}
+}
+
+static bool cpu_has_sse2()
+{
+#if defined(_M_X64) || defined(__x86_64__)
+	return true;
+#elif defined(_MSC_VER)
+	int regs[4];
+	__cpuid(regs, 1);
+	return (regs[3] & (1 << 26)) != 0;
+#else
+	return __builtin_cpu_supports("sse2");
+#endif
+}
+
+static bool cpu_has_avx2()
+{
+#ifdef _MSC_VER
+	int regs[4];
+	__cpuid(regs, 0);
+	if (regs[0] < 7)
+		return false;
+
+	// The OS must also save the YMM registers on context switches
+	__cpuid(regs, 1);
+	bool osxsave = (regs[2] & (1 << 27)) != 0;
+	if (!osxsave || (_xgetbv(0) & 0x6) != 0x6)
+		return false;
+
+	__cpuidex(regs, 7, 0);
+	return (regs[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // CONV_X86
+
+#ifdef CONV_NEON
+
+// vld2 splits even and odd samples, vrhadd averages them rounding up and
+// vst4 writes the U/Y/V/Y quadruplets back interleaved.
+static void convert_i444_to_uyvy_neon(uint8_t* input[], uint32_t in_linesize[],
+						  uint32_t start_y, uint32_t end_y,
+						  uint8_t* output, uint32_t out_linesize)
+{
+	uint32_t width = uyvy_width(out_linesize);
+	uint32_t simd_width = width & ~15u;
+
+	for (uint32_t y = start_y; y < end_y; ++y) {
+		const uint8_t* _Y = input[0] + (y * in_linesize[0]);
+		const uint8_t* _U = input[1] + (y * in_linesize[1]);
+		const uint8_t* _V = input[2] + (y * in_linesize[2]);
+		uint8_t* _out = output + (y * out_linesize);
+
+		for (uint32_t x = 0; x < simd_width; x += 16) {
+			uint8x8x2_t luma = vld2_u8(_Y + x);
+			uint8x8x2_t u = vld2_u8(_U + x);
+			uint8x8x2_t v = vld2_u8(_V + x);
+
+			uint8x8x4_t uyvy;
+			uyvy.val[0] = vrhadd_u8(u.val[0], u.val[1]);
+			uyvy.val[1] = luma.val[0];
+			uyvy.val[2] = vrhadd_u8(v.val[0], v.val[1]);
+			uyvy.val[3] = luma.val[1];
+
+			vst4_u8(_out + (x * 2), uyvy);
+		}
+
+		i444_to_uyvy_row_scalar(_Y, _U, _V, _out + (simd_width * 2),
+			simd_width, width);
+	}
+}
+
+static void interpolate_field_line_neon(const uint8_t* above,
+	const uint8_t* below, const uint8_t* other, uint8_t* output,
+	size_t size, uint8_t threshold)
+{
+	const uint8x16_t thres = vdupq_n_u8(threshold);
+	size_t simd_size = size & ~(size_t)15;
+
+	for (size_t i = 0; i < simd_size; i += 16) {
+		uint8x16_t avg = vrhaddq_u8(vld1q_u8(above + i), vld1q_u8(below + i));
+
+		if (other) {
+			uint8x16_t o = vld1q_u8(other + i);
+			uint8x16_t still = vcleq_u8(vabdq_u8(o, avg), thres);
+			avg = vbslq_u8(still, o, avg);
+		}
+
+		vst1q_u8(output + i, avg);
+	}
+
+	interpolate_field_line_scalar(above, below, other, output, simd_size,
+		size, threshold);
+}
+
+// vld4 splits U, even luma, V and odd luma, vst2 interleaves luma back
+static void split_uyvy_to_i422_neon(const uint8_t* input, uint32_t in_linesize,
+						  uint32_t width, uint32_t start_y, uint32_t end_y,
+						  uint8_t* output[], uint32_t out_linesize[])
+{
+	uint32_t simd_width = width & ~15u;
+
+	for (uint32_t y = start_y; y < end_y; ++y) {
+		const uint8_t* _in = input + (y * in_linesize);
+		uint8_t* _Y = output[0] + (y * out_linesize[0]);
+		uint8_t* _U = output[1] + (y * out_linesize[1]);
+		uint8_t* _V = output[2] + (y * out_linesize[2]);
+
+		for (uint32_t x = 0; x < simd_width; x += 16) {
+			uint8x8x4_t uyvy = vld4_u8(_in + (x * 2));
+
+			uint8x8x2_t luma;
+			luma.val[0] = uyvy.val[1];
+			luma.val[1] = uyvy.val[3];
+
+			vst2_u8(_Y + x, luma);
+			vst1_u8(_U + (x / 2), uyvy.val[0]);
+			vst1_u8(_V + (x / 2), uyvy.val[2]);
+		}
+
+		uyvy_to_i422_row_scalar(_in, _Y, _U, _V, simd_width, width);
+	}
+}
+
+#endif // CONV_NEON
+
+uyvy_conv_function get_i444_to_uyvy_function(const char** name)
+{
+	const char* selected = "scalar";
+	uyvy_conv_function func = convert_i444_to_uyvy_ref;
+
+#if defined(CONV_X86)
+	if (cpu_has_avx2()) {
+		selected = "AVX2";
+		func = convert_i444_to_uyvy_avx2;
+	} else if (cpu_has_sse2()) {
+		selected = "SSE2";
+		func = convert_i444_to_uyvy_sse2;
+	}
+#elif defined(CONV_NEON)
+	selected = "NEON";
+	func = convert_i444_to_uyvy_neon;
+#endif
+
+	if (name)
+		*name = selected;
+	return func;
+}
+
+uyvy_split_function get_uyvy_to_i422_function(const char** name)
+{
+	const char* selected = "scalar";
+	uyvy_split_function func = split_uyvy_to_i422_ref;
+
+#if defined(CONV_X86)
+	if (cpu_has_sse2()) {
+		selected = "SSE2";
+		func = split_uyvy_to_i422_sse2;
+	}
+#elif defined(CONV_NEON)
+	selected = "NEON";
+	func = split_uyvy_to_i422_neon;
+#endif
+
+	if (name)
+		*name = selected;
+	return func;
+}
+
+field_line_function get_field_line_function(const char** name)
+{
+	const char* selected = "scalar";
+	field_line_function func = interpolate_field_line_ref;
+
+#if defined(CONV_X86)
+	if (cpu_has_sse2()) {
+		selected = "SSE2";
+		func = interpolate_field_line_sse2;
+	}
+#elif defined(CONV_NEON)
+	selected = "NEON";
+	func = interpolate_field_line_neon;
+#endif
+
+	if (name)
+		*name = selected;
+	return func;
+}
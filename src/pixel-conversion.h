@@ -0,0 +1,75 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef void (*uyvy_conv_function)(uint8_t* input[], uint32_t in_linesize[],
+							  uint32_t start_y, uint32_t end_y,
+							  uint8_t* output, uint32_t out_linesize);
+
+// Reference implementation. Chroma is filtered by averaging each pair of
+// horizontally adjacent samples (rounding up), which is what every SIMD
+// variant below computes too: their output is bit-exact with this one.
+void convert_i444_to_uyvy_ref(uint8_t* input[], uint32_t in_linesize[],
+						  uint32_t start_y, uint32_t end_y,
+						  uint8_t* output, uint32_t out_linesize);
+
+// Returns the fastest I444 to UYVY converter supported by the running CPU.
+// If name isn't null, it receives a short name for the selected variant.
+uyvy_conv_function get_i444_to_uyvy_function(const char** name);
+
+// Reference for the NDI filter's GPU packing (data/ndi-convert.effect),
+// computed the same way in floating point: each pair of BGRA pixels gives
+// U, Y0, V, Y1 from the averaged colour for U and V. color_vecs are the
+// RGB to Y, U and V rows of the colour matrix, offset last. With alpha,
+// the alpha plane follows the last row, out_linesize / 2 bytes per row, as
+// in NDI's UYVA. Width must be even.
+void pack_bgra_to_uyvy_ref(const uint8_t* input, uint32_t in_linesize,
+	uint32_t width, uint32_t height, const float color_vecs[3][4],
+	bool alpha, uint8_t* output, uint32_t out_linesize);
+
+// Splits packed UYVY rows into Y, U and V planes (I422). Width is in pixels
+// and must be even.
+typedef void (*uyvy_split_function)(const uint8_t* input, uint32_t in_linesize,
+							  uint32_t width, uint32_t start_y, uint32_t end_y,
+							  uint8_t* output[], uint32_t out_linesize[]);
+
+void split_uyvy_to_i422_ref(const uint8_t* input, uint32_t in_linesize,
+						  uint32_t width, uint32_t start_y, uint32_t end_y,
+						  uint8_t* output[], uint32_t out_linesize[]);
+
+// Returns the fastest UYVY to I422 splitter supported by the running CPU
+uyvy_split_function get_uyvy_to_i422_function(const char** name);
+
+// Rebuilds a missing field line from the lines above and below it. With
+// other (the same line from the opposite field) set, each byte keeps the
+// other field's value when it's within threshold of the interpolation,
+// i.e. where the picture is still, and the interpolation otherwise.
+// Without it, every byte is interpolated. Works on any 8-bit format.
+typedef void (*field_line_function)(const uint8_t* above,
+	const uint8_t* below, const uint8_t* other, uint8_t* output,
+	size_t size, uint8_t threshold);
+
+void interpolate_field_line_ref(const uint8_t* above, const uint8_t* below,
+	const uint8_t* other, uint8_t* output, size_t size, uint8_t threshold);
+
+// Returns the fastest field line interpolator supported by the running CPU
+field_line_function get_field_line_function(const char** name);
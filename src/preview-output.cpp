@@ -24,17 +24,19 @@ along with this program; If not, see <https://www.gnu.org/licenses/>
 #include <media-io/video-frame.h>
 
 #include "obs-ndi.h"
+#include "readback-ring.h"
+#include "Config.h"
+#include "connection-monitor.h"
 
 struct preview_output {
 	bool enabled;
 	obs_source_t* current_source;
 	obs_output_t* output;
+	struct ndi_connection_watch* connections;
 
 	video_t* video_queue;
 	gs_texrender_t* texrender;
-	gs_stagesurf_t* stagesurface;
-	uint8_t* video_data;
-	uint32_t video_linesize;
+	struct readback_ring readback;
 
 	obs_video_info ovi;
 };
@@ -52,6 +54,16 @@ void preview_output_init(const char* default_name)
 			"ndi_output", "NDI Preview Output", output_settings, nullptr
 	);
 	obs_data_release(output_settings);
+
+	// Owned by the output, valid until it is released
+	calldata_t cd;
+	calldata_init(&cd);
+	proc_handler_t* ph = obs_output_get_proc_handler(context.output);
+	if (proc_handler_call(ph, "get_connection_watch", &cd)) {
+		context.connections =
+			(struct ndi_connection_watch*)calldata_ptr(&cd, "watch");
+	}
+	calldata_free(&cd);
 }
 
 void preview_output_start(const char* output_name)
@@ -67,9 +79,15 @@ void preview_output_start(const char* output_name)
 
 	obs_enter_graphics();
 	context.texrender = gs_texrender_create(GS_BGRA, GS_ZS_NONE);
-	context.stagesurface = gs_stagesurface_create(width, height, GS_BGRA);
+	readback_ring_update(&context.readback, width, height, GS_BGRA,
+		Config::Current()->PreviewReadbackDepth);
 	obs_leave_graphics();
 
+	blog(LOG_INFO, "NDI preview output readback depth %u (+%.1f ms latency)",
+		context.readback.depth,
+		readback_ring_latency_ns(&context.readback,
+			context.ovi.fps_num, context.ovi.fps_den) / 1000000.0);
+
 	const video_output_info* mainVOI = video_output_get_info(obs_get_video());
 
 	video_output_info vi = { 0 };
@@ -118,7 +136,7 @@ void preview_output_stop()
 	obs_source_release(context.current_source);
 
 	obs_enter_graphics();
-	gs_stagesurface_destroy(context.stagesurface);
+	readback_ring_free(&context.readback);
 	gs_texrender_destroy(context.texrender);
 	obs_leave_graphics();
 
@@ -129,6 +147,7 @@ void preview_output_stop()
 
 void preview_output_deinit()
 {
+	context.connections = nullptr;
 	obs_output_release(context.output);
 
 	context.output = nullptr;
@@ -170,6 +189,11 @@ void render_preview_source(void* param, uint32_t cx, uint32_t cy)
 
 	if (!ctx->current_source) return;
 
+	if (!ndi_connection_watch_has_receivers(ctx->connections)) {
+		readback_ring_discard(&ctx->readback);
+		return;
+	}
+
 	uint32_t width = obs_source_get_base_width(ctx->current_source);
 	uint32_t height = obs_source_get_base_height(ctx->current_source);
 
@@ -190,27 +214,34 @@ void render_preview_source(void* param, uint32_t cx, uint32_t cy)
 		gs_blend_state_pop();
 		gs_texrender_end(ctx->texrender);
 
+		readback_ring_stage(&ctx->readback,
+			gs_texrender_get_texture(ctx->texrender), os_gettime_ns());
+
+		uint8_t* video_data;
+		uint32_t video_linesize;
+		uint64_t timestamp;
+		if (!readback_ring_map(&ctx->readback,
+			&video_data, &video_linesize, &timestamp))
+		{
+			return;
+		}
+
 		struct video_frame output_frame;
 		if (video_output_lock_frame(ctx->video_queue,
-			&output_frame, 1, os_gettime_ns()))
+			&output_frame, 1, timestamp))
 		{
-			gs_stage_texture(ctx->stagesurface, gs_texrender_get_texture(ctx->texrender));
-
-			if (gs_stagesurface_map(ctx->stagesurface, &ctx->video_data, &ctx->video_linesize)) {
-				uint32_t linesize = output_frame.linesize[0];
-				for (uint32_t i = 0; i < ctx->ovi.base_height; i++) {
-					uint32_t dst_offset = linesize * i;
-					uint32_t src_offset = ctx->video_linesize * i;
-					memcpy(output_frame.data[0] + dst_offset,
-						ctx->video_data + src_offset,
-						linesize);
-				}
-
-				gs_stagesurface_unmap(ctx->stagesurface);
-				ctx->video_data = nullptr;
+			uint32_t linesize = output_frame.linesize[0];
+			for (uint32_t i = 0; i < ctx->ovi.base_height; i++) {
+				uint32_t dst_offset = linesize * i;
+				uint32_t src_offset = video_linesize * i;
+				memcpy(output_frame.data[0] + dst_offset,
+					video_data + src_offset,
+					linesize);
 			}
 
 			video_output_unlock_frame(ctx->video_queue);
 		}
+
+		readback_ring_unmap(&ctx->readback);
 	}
 }
\ No newline at end of file
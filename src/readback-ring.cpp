@@ -0,0 +1,111 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "readback-ring.h"
+
+static void readback_ring_destroy_surfaces(struct readback_ring* ring)
+{
+	for (uint32_t i = 0; i <= READBACK_RING_MAX_DEPTH; ++i) {
+		gs_stagesurface_destroy(ring->surfaces[i]);
+		ring->surfaces[i] = nullptr;
+	}
+}
+
+bool readback_ring_update(struct readback_ring* ring, uint32_t width,
+	uint32_t height, enum gs_color_format format, uint32_t depth)
+{
+	if (depth > READBACK_RING_MAX_DEPTH)
+		depth = READBACK_RING_MAX_DEPTH;
+
+	if (ring->surfaces[0] && ring->width == width &&
+		ring->height == height && ring->format == format &&
+		ring->depth == depth)
+	{
+		return false;
+	}
+
+	readback_ring_destroy_surfaces(ring);
+
+	for (uint32_t i = 0; i <= depth; ++i) {
+		ring->surfaces[i] = gs_stagesurface_create(width, height, format);
+	}
+
+	ring->width = width;
+	ring->height = height;
+	ring->format = format;
+	ring->depth = depth;
+	ring->write_index = 0;
+	ring->staged_count = 0;
+	return true;
+}
+
+void readback_ring_stage(struct readback_ring* ring, gs_texture_t* texture,
+	uint64_t timestamp)
+{
+	if (!ring->surfaces[0])
+		return;
+
+	gs_stage_texture(ring->surfaces[ring->write_index], texture);
+	ring->timestamps[ring->write_index] = timestamp;
+
+	ring->write_index = (ring->write_index + 1) % (ring->depth + 1);
+	if (ring->staged_count <= ring->depth)
+		ring->staged_count++;
+}
+
+bool readback_ring_map(struct readback_ring* ring, uint8_t** data,
+	uint32_t* linesize, uint64_t* timestamp)
+{
+	if (ring->staged_count <= ring->depth)
+		return false;
+
+	// The surface written next holds the frame staged "depth" frames ago
+	uint32_t index = ring->write_index;
+
+	if (!gs_stagesurface_map(ring->surfaces[index], data, linesize))
+		return false;
+
+	ring->mapped_index = index;
+	*timestamp = ring->timestamps[index];
+	return true;
+}
+
+void readback_ring_unmap(struct readback_ring* ring)
+{
+	gs_stagesurface_unmap(ring->surfaces[ring->mapped_index]);
+}
+
+void readback_ring_discard(struct readback_ring* ring)
+{
+	ring->staged_count = 0;
+}
+
+void readback_ring_free(struct readback_ring* ring)
+{
+	readback_ring_destroy_surfaces(ring);
+	ring->staged_count = 0;
+}
+
+uint64_t readback_ring_latency_ns(const struct readback_ring* ring,
+	uint32_t fps_num, uint32_t fps_den)
+{
+	if (!fps_num)
+		return 0;
+
+	return (uint64_t)ring->depth * 1000000000ULL * fps_den / fps_num;
+}
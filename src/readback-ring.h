@@ -0,0 +1,67 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <obs.h>
+
+#define READBACK_RING_MAX_DEPTH 3
+
+// Ring of stage surfaces used to read rendered frames back from the GPU
+// without stalling. Each frame is staged into the next surface and the frame
+// staged "depth" frames earlier is mapped, by which time the GPU is done
+// with its copy. A depth of 0 maps the frame that was just staged, which
+// stalls like a single stage surface would.
+//
+// All functions must be called from the graphics thread.
+struct readback_ring
+{
+	gs_stagesurf_t* surfaces[READBACK_RING_MAX_DEPTH + 1];
+	uint64_t timestamps[READBACK_RING_MAX_DEPTH + 1];
+	uint32_t depth;
+	uint32_t width;
+	uint32_t height;
+	enum gs_color_format format;
+
+	uint32_t write_index;
+	uint32_t staged_count;
+	uint32_t mapped_index;
+};
+
+// (Re)creates the surfaces when the frame size or depth changed, in which
+// case frames staged so far are discarded. Returns true when that happened.
+bool readback_ring_update(struct readback_ring* ring, uint32_t width,
+	uint32_t height, enum gs_color_format format, uint32_t depth);
+
+void readback_ring_stage(struct readback_ring* ring, gs_texture_t* texture,
+	uint64_t timestamp);
+
+// Maps the oldest staged frame once "depth" newer ones have been staged.
+// timestamp receives the time the mapped frame was staged at.
+bool readback_ring_map(struct readback_ring* ring, uint8_t** data,
+	uint32_t* linesize, uint64_t* timestamp);
+void readback_ring_unmap(struct readback_ring* ring);
+
+// Forgets staged frames, for when rendering is paused and resumed later
+void readback_ring_discard(struct readback_ring* ring);
+
+void readback_ring_free(struct readback_ring* ring);
+
+// Latency added by the ring at the given frame rate
+uint64_t readback_ring_latency_ns(const struct readback_ring* ring,
+	uint32_t fps_num, uint32_t fps_den);
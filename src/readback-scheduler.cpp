@@ -0,0 +1,488 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <string.h>
+
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#include "obs-ndi.h"
+#include "readback-scheduler.h"
+
+// Frames of a single filter waiting for a send worker, past which the
+// oldest is dropped
+#define MAX_QUEUED_PER_CLIENT 2
+
+#define MAX_SEND_WORKERS 4
+
+// Frame buffers kept for reuse once sent
+#define MAX_FREE_JOBS 8
+
+#define STATS_LOG_INTERVAL_NS 60000000000ULL
+
+struct readback_client
+{
+	obs_source_t* source;
+	struct readback_client_callbacks callbacks;
+	void* param;
+
+	// Frame staged by the current render callback. Graphics thread only.
+	struct readback_ring* ring;
+	struct readback_layout layout;
+	uint64_t stage_ns;
+
+	// Guarded by the clients mutex. In the render callback's snapshot,
+	// and destroyed from a stage callback: the render callback frees it.
+	bool rendering;
+	bool destroyed;
+
+	// Guarded by the queue mutex. The last job sent stays held until the
+	// next send returns.
+	bool busy;
+	uint32_t queued;
+	struct readback_job* held;
+	struct readback_client_stats stats;
+
+	struct readback_client* next;
+};
+
+struct readback_job
+{
+	struct readback_client* client;
+	uint8_t* data;
+	size_t capacity;
+	struct readback_layout layout;
+	uint64_t timestamp;
+
+	struct readback_job* next;
+};
+
+static struct {
+	// Held by the render callback while it takes a snapshot of the
+	// clients, not while it renders them
+	pthread_mutex_t clients_mutex;
+	pthread_cond_t clients_cond;
+	struct readback_client* clients;
+
+	// Graphics thread only
+	struct readback_client** snapshot;
+	uint32_t snapshot_capacity;
+	pthread_t render_thread;
+	bool rendering;
+
+	pthread_mutex_t queue_mutex;
+	pthread_cond_t queue_cond;
+	struct readback_job* queue_head;
+	struct readback_job* queue_tail;
+	struct readback_job* free_jobs;
+	uint32_t free_count;
+	bool stopping;
+
+	pthread_t workers[MAX_SEND_WORKERS];
+	uint32_t worker_count;
+
+	// Graphics thread only
+	double frame_ms;
+	uint64_t last_log_ts;
+
+	bool initialized;
+} scheduler;
+
+static inline void smooth_ms(double* average, uint64_t ns)
+{
+	*average += ((double)ns / 1000000.0 - *average) / 16.0;
+}
+
+// Queue mutex held
+static void recycle_job(struct readback_job* job)
+{
+	if (!job)
+		return;
+
+	if (scheduler.free_count >= MAX_FREE_JOBS) {
+		bfree(job->data);
+		bfree(job);
+		return;
+	}
+
+	job->client = nullptr;
+	job->next = scheduler.free_jobs;
+	scheduler.free_jobs = job;
+	scheduler.free_count++;
+}
+
+// Queue mutex held. Removes and returns the first queued job matching
+// client, or the first one of a client not being sent to if client is null.
+static struct readback_job* take_job(struct readback_client* client)
+{
+	struct readback_job* prev = nullptr;
+	for (auto job = scheduler.queue_head; job; prev = job, job = job->next) {
+		if (client ? (job->client != client) : job->client->busy)
+			continue;
+
+		if (prev)
+			prev->next = job->next;
+		else
+			scheduler.queue_head = job->next;
+		if (scheduler.queue_tail == job)
+			scheduler.queue_tail = prev;
+
+		job->next = nullptr;
+		job->client->queued--;
+		return job;
+	}
+	return nullptr;
+}
+
+static void* send_worker_thread(void* data)
+{
+	UNUSED_PARAMETER(data);
+	os_set_thread_name("obs-ndi: send worker");
+
+	pthread_mutex_lock(&scheduler.queue_mutex);
+	while (!scheduler.stopping) {
+		struct readback_job* job = take_job(nullptr);
+		if (!job) {
+			pthread_cond_wait(&scheduler.queue_cond, &scheduler.queue_mutex);
+			continue;
+		}
+
+		struct readback_client* client = job->client;
+		client->busy = true;
+		pthread_mutex_unlock(&scheduler.queue_mutex);
+
+		uint64_t start = os_gettime_ns();
+		client->callbacks.send(client->param, job->data, &job->layout,
+			job->timestamp);
+		uint64_t elapsed = os_gettime_ns() - start;
+
+		pthread_mutex_lock(&scheduler.queue_mutex);
+		client->busy = false;
+		client->stats.frames_sent++;
+		smooth_ms(&client->stats.send_ms, elapsed);
+
+		// The SDK is done with the previous frame once the next send
+		// returns
+		recycle_job(client->held);
+		client->held = job;
+
+		// Further frames of this client are runnable again, and
+		// readback_client_destroy may be waiting for this one
+		pthread_cond_broadcast(&scheduler.queue_cond);
+	}
+	pthread_mutex_unlock(&scheduler.queue_mutex);
+
+	return nullptr;
+}
+
+static struct readback_job* acquire_job(size_t size)
+{
+	pthread_mutex_lock(&scheduler.queue_mutex);
+	struct readback_job* job = scheduler.free_jobs;
+	if (job) {
+		scheduler.free_jobs = job->next;
+		scheduler.free_count--;
+	}
+	pthread_mutex_unlock(&scheduler.queue_mutex);
+
+	if (!job)
+		job = (struct readback_job*)bzalloc(sizeof(struct readback_job));
+
+	if (job->capacity < size) {
+		job->data = (uint8_t*)brealloc(job->data, size);
+		job->capacity = size;
+	}
+	job->next = nullptr;
+	return job;
+}
+
+static void queue_job(struct readback_client* client,
+	struct readback_job* job, uint64_t map_ns)
+{
+	pthread_mutex_lock(&scheduler.queue_mutex);
+
+	if (client->queued >= MAX_QUEUED_PER_CLIENT) {
+		recycle_job(take_job(client));
+		client->stats.frames_dropped++;
+	}
+
+	job->client = client;
+	if (scheduler.queue_tail)
+		scheduler.queue_tail->next = job;
+	else
+		scheduler.queue_head = job;
+	scheduler.queue_tail = job;
+	client->queued++;
+
+	smooth_ms(&client->stats.stage_ms, client->stage_ns);
+	smooth_ms(&client->stats.map_ms, map_ns);
+
+	pthread_cond_broadcast(&scheduler.queue_cond);
+	pthread_mutex_unlock(&scheduler.queue_mutex);
+}
+
+static void read_frame(struct readback_client* client)
+{
+	uint64_t start = os_gettime_ns();
+
+	uint8_t* data;
+	uint32_t linesize;
+	uint64_t timestamp;
+	if (!readback_ring_map(client->ring, &data, &linesize, &timestamp))
+		return;
+
+	const uint32_t row_size = client->layout.row_size;
+	struct readback_job* job =
+		acquire_job((size_t)row_size * client->layout.rows);
+	job->layout = client->layout;
+	job->timestamp = timestamp;
+
+	// The only copy of the frame: it is sent from the job's buffer
+	if (linesize == row_size) {
+		memcpy(job->data, data, (size_t)row_size * client->layout.rows);
+	} else {
+		const uint32_t copy_size =
+			(linesize < row_size) ? linesize : row_size;
+		for (uint32_t y = 0; y < client->layout.rows; ++y) {
+			memcpy(job->data + (size_t)y * row_size,
+				data + (size_t)y * linesize, copy_size);
+		}
+	}
+
+	readback_ring_unmap(client->ring);
+	queue_job(client, job, os_gettime_ns() - start);
+}
+
+static void log_stats(uint32_t client_count)
+{
+	blog(LOG_INFO, "readback: %u filters, %.2f ms per frame on the "
+		"graphics thread, %u send workers", client_count,
+		scheduler.frame_ms, scheduler.worker_count);
+
+	for (auto c = scheduler.clients; c; c = c->next) {
+		struct readback_client_stats stats;
+		readback_client_get_stats(c, &stats);
+
+		blog(LOG_INFO, "'%s': stage %.2f ms, readback %.2f ms, "
+			"send %.2f ms | %llu sent, %llu dropped",
+			obs_source_get_name(c->source),
+			stats.stage_ms, stats.map_ms, stats.send_ms,
+			(unsigned long long)stats.frames_sent,
+			(unsigned long long)stats.frames_dropped);
+	}
+}
+
+static void readback_scheduler_render(void* data, uint32_t cx, uint32_t cy)
+{
+	UNUSED_PARAMETER(data);
+	UNUSED_PARAMETER(cx);
+	UNUSED_PARAMETER(cy);
+
+	// Clients are rendered outside of the lock, which would otherwise be
+	// held while rendering the filters' parents
+	pthread_mutex_lock(&scheduler.clients_mutex);
+	uint32_t client_count = 0;
+	for (auto c = scheduler.clients; c; c = c->next) {
+		if (client_count == scheduler.snapshot_capacity) {
+			scheduler.snapshot_capacity = client_count ?
+				client_count * 2 : 8;
+			scheduler.snapshot = (struct readback_client**)brealloc(
+				scheduler.snapshot, sizeof(struct readback_client*) *
+				scheduler.snapshot_capacity);
+		}
+		c->rendering = true;
+		scheduler.snapshot[client_count++] = c;
+	}
+	scheduler.render_thread = pthread_self();
+	scheduler.rendering = true;
+	pthread_mutex_unlock(&scheduler.clients_mutex);
+
+	if (!client_count) {
+		scheduler.rendering = false;
+		return;
+	}
+
+	const uint64_t start = os_gettime_ns();
+
+	// Issue every copy before waiting on any of them. A client destroyed
+	// by a stage callback is skipped from then on.
+	for (uint32_t i = 0; i < client_count; ++i) {
+		struct readback_client* c = scheduler.snapshot[i];
+		if (c->destroyed)
+			continue;
+
+		uint64_t stage_start = os_gettime_ns();
+		c->ring = c->callbacks.stage(c->param, &c->layout);
+		c->stage_ns = os_gettime_ns() - stage_start;
+	}
+
+	for (uint32_t i = 0; i < client_count; ++i) {
+		struct readback_client* c = scheduler.snapshot[i];
+		if (c->ring && !c->destroyed)
+			read_frame(c);
+		c->ring = nullptr;
+	}
+
+	const uint64_t end = os_gettime_ns();
+	smooth_ms(&scheduler.frame_ms, end - start);
+
+	pthread_mutex_lock(&scheduler.clients_mutex);
+	scheduler.rendering = false;
+	for (uint32_t i = 0; i < client_count; ++i) {
+		struct readback_client* c = scheduler.snapshot[i];
+		c->rendering = false;
+		if (c->destroyed)
+			bfree(c);
+	}
+	pthread_cond_broadcast(&scheduler.clients_cond);
+
+	if (end - scheduler.last_log_ts >= STATS_LOG_INTERVAL_NS) {
+		if (scheduler.last_log_ts)
+			log_stats(client_count);
+		scheduler.last_log_ts = end;
+	}
+	pthread_mutex_unlock(&scheduler.clients_mutex);
+}
+
+void readback_scheduler_init()
+{
+	pthread_mutex_init(&scheduler.clients_mutex, NULL);
+	pthread_cond_init(&scheduler.clients_cond, NULL);
+	pthread_mutex_init(&scheduler.queue_mutex, NULL);
+	pthread_cond_init(&scheduler.queue_cond, NULL);
+	scheduler.stopping = false;
+
+	int workers = os_get_logical_cores() / 2;
+	if (workers < 1)
+		workers = 1;
+	if (workers > MAX_SEND_WORKERS)
+		workers = MAX_SEND_WORKERS;
+
+	scheduler.worker_count = 0;
+	for (int i = 0; i < workers; ++i) {
+		if (pthread_create(&scheduler.workers[scheduler.worker_count],
+			nullptr, send_worker_thread, nullptr) == 0)
+		{
+			scheduler.worker_count++;
+		}
+	}
+
+	obs_add_main_render_callback(readback_scheduler_render, nullptr);
+	scheduler.initialized = true;
+}
+
+void readback_scheduler_deinit()
+{
+	if (!scheduler.initialized)
+		return;
+
+	obs_remove_main_render_callback(readback_scheduler_render, nullptr);
+
+	pthread_mutex_lock(&scheduler.queue_mutex);
+	scheduler.stopping = true;
+	pthread_cond_broadcast(&scheduler.queue_cond);
+	pthread_mutex_unlock(&scheduler.queue_mutex);
+
+	for (uint32_t i = 0; i < scheduler.worker_count; ++i)
+		pthread_join(scheduler.workers[i], nullptr);
+	scheduler.worker_count = 0;
+
+	while (scheduler.free_jobs) {
+		struct readback_job* job = scheduler.free_jobs;
+		scheduler.free_jobs = job->next;
+		bfree(job->data);
+		bfree(job);
+	}
+	scheduler.free_count = 0;
+
+	bfree(scheduler.snapshot);
+	scheduler.snapshot = nullptr;
+	scheduler.snapshot_capacity = 0;
+
+	pthread_cond_destroy(&scheduler.queue_cond);
+	pthread_mutex_destroy(&scheduler.queue_mutex);
+	pthread_cond_destroy(&scheduler.clients_cond);
+	pthread_mutex_destroy(&scheduler.clients_mutex);
+	scheduler.initialized = false;
+}
+
+struct readback_client* readback_client_create(obs_source_t* source,
+	const struct readback_client_callbacks* callbacks, void* param)
+{
+	auto c = (struct readback_client*)bzalloc(
+		sizeof(struct readback_client));
+	c->source = source;
+	c->callbacks = *callbacks;
+	c->param = param;
+
+	pthread_mutex_lock(&scheduler.clients_mutex);
+	c->next = scheduler.clients;
+	scheduler.clients = c;
+	pthread_mutex_unlock(&scheduler.clients_mutex);
+
+	return c;
+}
+
+void readback_client_destroy(struct readback_client* client)
+{
+	if (!client)
+		return;
+
+	// Once unlinked, the next render callbacks don't stage for it anymore.
+	// The current one is waited for, unless this is called from it.
+	pthread_mutex_lock(&scheduler.clients_mutex);
+	struct readback_client** link = &scheduler.clients;
+	while (*link && *link != client)
+		link = &(*link)->next;
+	if (*link)
+		*link = client->next;
+
+	const bool from_render = scheduler.rendering &&
+		pthread_equal(scheduler.render_thread, pthread_self());
+	while (client->rendering && !from_render)
+		pthread_cond_wait(&scheduler.clients_cond, &scheduler.clients_mutex);
+	pthread_mutex_unlock(&scheduler.clients_mutex);
+
+	pthread_mutex_lock(&scheduler.queue_mutex);
+	struct readback_job* job;
+	while ((job = take_job(client)) != nullptr)
+		recycle_job(job);
+	while (client->busy)
+		pthread_cond_wait(&scheduler.queue_cond, &scheduler.queue_mutex);
+	recycle_job(client->held);
+	client->held = nullptr;
+	pthread_mutex_unlock(&scheduler.queue_mutex);
+
+	// Left to the render callback to free when it still holds it
+	pthread_mutex_lock(&scheduler.clients_mutex);
+	bool deferred = client->rendering;
+	client->destroyed = true;
+	pthread_mutex_unlock(&scheduler.clients_mutex);
+
+	if (!deferred)
+		bfree(client);
+}
+
+void readback_client_get_stats(struct readback_client* client,
+	struct readback_client_stats* stats)
+{
+	pthread_mutex_lock(&scheduler.queue_mutex);
+	*stats = client->stats;
+	pthread_mutex_unlock(&scheduler.queue_mutex);
+}
@@ -0,0 +1,86 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <obs.h>
+
+#include "readback-ring.h"
+
+// Reads back the frames of every NDI filter from a single main render
+// callback: all filters stage their frame first, then all staged frames are
+// mapped, so that the GPU copies overlap instead of each filter stalling on
+// its own. Mapped frames are copied out and sent by a small pool of send
+// workers shared by all filters. Frames of a given filter are sent one at a
+// time and in order; when a filter's send falls behind, its oldest queued
+// frame is dropped.
+void readback_scheduler_init();
+void readback_scheduler_deinit();
+
+struct readback_client;
+
+// Frame layout, as staged. Sent frames are copied with rows of row_size
+// bytes, width, height and format are for the client.
+struct readback_layout
+{
+	uint32_t row_size;
+	uint32_t rows;
+	uint32_t width;
+	uint32_t height;
+	uint32_t format;
+
+	// Frames rendered by OBS per frame staged, for the send callback
+	uint32_t frame_divisor;
+};
+
+struct readback_client_callbacks
+{
+	// Graphics thread: renders and stages the next frame. Returns the ring
+	// to map a frame from, and fills layout, or returns null to skip.
+	struct readback_ring* (*stage)(void* param,
+		struct readback_layout* layout);
+
+	// Send worker: outputs a frame mapped from the ring. Data stays valid
+	// until the client's next send returns, so it can be handed as is to
+	// an asynchronous NDI send.
+	void (*send)(void* param, const uint8_t* data,
+		const struct readback_layout* layout, uint64_t timestamp);
+};
+
+struct readback_client_stats
+{
+	uint64_t frames_sent;
+	uint64_t frames_dropped;
+
+	// Smoothed time spent per frame on each step
+	double stage_ms;
+	double map_ms;
+	double send_ms;
+};
+
+struct readback_client* readback_client_create(obs_source_t* source,
+	const struct readback_client_callbacks* callbacks, void* param);
+
+// Once this returns, the callbacks aren't running and won't be called
+// anymore, and the data of the last frame sent is released: asynchronous
+// sends using it must have been flushed. May be called from a stage
+// callback.
+void readback_client_destroy(struct readback_client* client);
+
+void readback_client_get_stats(struct readback_client* client,
+	struct readback_client_stats* stats);
@@ -0,0 +1,56 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <obs-module.h>
+
+#include "obs-ndi.h"
+#include "send-buffers.h"
+
+uint8_t* ndi_send_buffers_acquire(struct ndi_send_buffers* buffers,
+	NDIlib_send_instance_t sender, size_t size)
+{
+	if (size > buffers->size) {
+		ndi_send_buffers_flush(sender);
+
+		for (int i = 0; i < NDI_SEND_BUFFER_COUNT; ++i) {
+			bfree(buffers->data[i]);
+			buffers->data[i] = (uint8_t*)bmalloc(size);
+		}
+		buffers->size = size;
+	}
+
+	buffers->index = (buffers->index + 1) % NDI_SEND_BUFFER_COUNT;
+	return buffers->data[buffers->index];
+}
+
+void ndi_send_buffers_flush(NDIlib_send_instance_t sender)
+{
+	if (sender) {
+		ndiLib->NDIlib_send_send_video_async_v2(sender, nullptr);
+	}
+}
+
+void ndi_send_buffers_free(struct ndi_send_buffers* buffers)
+{
+	for (int i = 0; i < NDI_SEND_BUFFER_COUNT; ++i) {
+		bfree(buffers->data[i]);
+		buffers->data[i] = nullptr;
+	}
+	buffers->size = 0;
+	buffers->index = 0;
+}
@@ -0,0 +1,46 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <Processing.NDI.Lib.h>
+
+// With NDIlib_send_send_video_async_v2, the SDK keeps using a frame's
+// buffer until the next send call on the same sender (or a flush). Two
+// buffers used in turn are therefore enough: the one we fill is always the
+// one released by the previous send.
+#define NDI_SEND_BUFFER_COUNT 2
+
+struct ndi_send_buffers
+{
+	uint8_t* data[NDI_SEND_BUFFER_COUNT];
+	size_t size;
+	uint32_t index;
+};
+
+// Returns the next buffer to fill, at least size bytes large. Growing the
+// buffers flushes any pending asynchronous send on sender first.
+uint8_t* ndi_send_buffers_acquire(struct ndi_send_buffers* buffers,
+	NDIlib_send_instance_t sender, size_t size);
+
+// Waits for the SDK to release the buffer of the last asynchronous send
+void ndi_send_buffers_flush(NDIlib_send_instance_t sender);
+
+void ndi_send_buffers_free(struct ndi_send_buffers* buffers);
@@ -0,0 +1,112 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <obs-module.h>
+#include <util/threading.h>
+
+#include "obs-ndi.h"
+#include "send-buffers.h"
+#include "sender-handle.h"
+
+struct ndi_sender_handle* ndi_sender_acquire(struct ndi_sender_slot* slot)
+{
+	// Announcing the read first lets a replace know when no reader can
+	// still be about to pin the handle it just unpublished
+	os_atomic_inc_long(&slot->pinning);
+
+	long index = os_atomic_load_long(&slot->current);
+	struct ndi_sender_handle* handle = slot->handles[index];
+	if (handle)
+		os_atomic_inc_long(&handle->refs);
+
+	// The last reader out and a waiting replace race to claim the wakeup,
+	// so that exactly one signal answers each wait
+	if (os_atomic_dec_long(&slot->pinning) == 0 &&
+		os_atomic_load_long(&slot->draining) &&
+		os_atomic_compare_swap_long(&slot->draining, 1, 0))
+		os_event_signal(slot->drained);
+
+	return handle;
+}
+
+void ndi_sender_handle_release(struct ndi_sender_handle* handle)
+{
+	// Only reaches zero once unpublished. The replace waits for the
+	// signal before freeing the handle.
+	if (os_atomic_dec_long(&handle->refs) == 0)
+		os_event_signal(handle->released);
+}
+
+static void ndi_sender_handle_destroy(struct ndi_sender_handle* handle)
+{
+	if (!handle)
+		return;
+
+	// Unpublished: dropping the slot's reference leaves the sends still
+	// using the handle, the last of which signals
+	if (os_atomic_dec_long(&handle->refs) != 0)
+		os_event_wait(handle->released);
+	os_event_destroy(handle->released);
+
+	// Async video sends read the caller's buffer until flushed
+	ndi_send_buffers_flush(handle->sender);
+	ndiLib->NDIlib_send_destroy(handle->sender);
+	bfree(handle);
+}
+
+void ndi_sender_replace(struct ndi_sender_slot* slot,
+	NDIlib_send_instance_t sender, bool async_send)
+{
+	struct ndi_sender_handle* handle = nullptr;
+	if (sender) {
+		handle = (struct ndi_sender_handle*)bzalloc(
+			sizeof(struct ndi_sender_handle));
+		handle->sender = sender;
+		handle->async_send = async_send;
+		handle->refs = 1;
+		os_event_init(&handle->released, OS_EVENT_TYPE_AUTO);
+	}
+
+	// Only replaces use the event, and they aren't reentrant
+	if (!slot->drained)
+		os_event_init(&slot->drained, OS_EVENT_TYPE_AUTO);
+
+	// The unused slot is free: the previous replace emptied it
+	long index = os_atomic_load_long(&slot->current);
+	struct ndi_sender_handle* previous = slot->handles[index];
+	slot->handles[1 - index] = handle;
+	os_atomic_set_long(&slot->current, 1 - index);
+
+	// Grace period: readers that loaded the old index have either pinned
+	// the previous handle or given up on it once this drops to zero
+	os_atomic_set_long(&slot->draining, 1);
+	if (os_atomic_load_long(&slot->pinning) != 0 ||
+		!os_atomic_compare_swap_long(&slot->draining, 1, 0))
+		os_event_wait(slot->drained);
+
+	slot->handles[index] = nullptr;
+	ndi_sender_handle_destroy(previous);
+}
+
+void ndi_sender_slot_free(struct ndi_sender_slot* slot)
+{
+	ndi_sender_replace(slot, nullptr, false);
+
+	os_event_destroy(slot->drained);
+	slot->drained = nullptr;
+}
@@ -0,0 +1,66 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <util/threading.h>
+#include <Processing.NDI.Lib.h>
+
+// A sender, with the settings it was created with. Immutable once
+// published.
+struct ndi_sender_handle
+{
+	NDIlib_send_instance_t sender;
+	bool async_send;
+
+	// Includes the slot's own reference while published. Once it's
+	// dropped, the last release signals the event.
+	volatile long refs;
+	os_event_t* released;
+};
+
+// Publishes the current sender to the send paths without locking them.
+// Readers pin a handle for the duration of a send; replacing the sender
+// only swaps the published handle, then waits for sends still using the
+// old one before destroying it, like RCU. Replacing is meant for the
+// (rare) settings updates and is not reentrant.
+struct ndi_sender_slot
+{
+	struct ndi_sender_handle* handles[2];
+	volatile long current;
+
+	// Readers between loading the published handle and pinning it. While
+	// a replace waits for them, the last one out signals its event.
+	volatile long pinning;
+	volatile long draining;
+	os_event_t* drained;
+};
+
+// Never blocks. Returns null when there is no sender; otherwise the handle
+// must be given back with ndi_sender_handle_release.
+struct ndi_sender_handle* ndi_sender_acquire(struct ndi_sender_slot* slot);
+void ndi_sender_handle_release(struct ndi_sender_handle* handle);
+
+// Publishes sender, which may be null, in place of the current one, then
+// destroys the previous sender once no send uses it anymore
+void ndi_sender_replace(struct ndi_sender_slot* slot,
+	NDIlib_send_instance_t sender, bool async_send);
+
+// Destroys the current sender
+void ndi_sender_slot_free(struct ndi_sender_slot* slot);
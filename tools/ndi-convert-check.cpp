@@ -0,0 +1,220 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+// Checks the NDI filter's GPU packing (data/ndi-convert.effect) against
+// the CPU reference, pack_bgra_to_uyvy_ref. Random BGRA frames of a few
+// sizes are packed to UYVY and UYVA with the 601 and 709 matrices in both
+// ranges, read back, and compared byte by byte: the check fails if any
+// byte is off by more than 1. Starts libobs with its default graphics
+// module, so it needs a GPU (and a display where OpenGL requires one).
+//
+// Usage: ndi-convert-check <path to ndi-convert.effect>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <obs.h>
+#include <util/bmem.h>
+
+#include "gpu-packing.h"
+#include "pixel-conversion.h"
+
+#ifdef _WIN32
+#define GRAPHICS_MODULE "libobs-d3d11"
+#else
+#define GRAPHICS_MODULE "libobs-opengl"
+#endif
+
+#define MAX_DIFFERENCE 1
+
+struct check_size
+{
+	uint32_t width;
+	uint32_t height;
+};
+
+// Odd pairs of pixels and sizes off the usual ones included
+static const struct check_size check_sizes[] = {
+	{ 64, 36 },
+	{ 100, 50 },
+	{ 1280, 720 },
+	{ 1282, 722 },
+	{ 1920, 1080 },
+};
+
+struct check_matrix
+{
+	enum video_colorspace colorspace;
+	enum video_range_type range;
+	const char* name;
+};
+
+static const struct check_matrix check_matrices[] = {
+	{ VIDEO_CS_601, VIDEO_RANGE_PARTIAL, "601 partial" },
+	{ VIDEO_CS_601, VIDEO_RANGE_FULL, "601 full" },
+	{ VIDEO_CS_709, VIDEO_RANGE_PARTIAL, "709 partial" },
+	{ VIDEO_CS_709, VIDEO_RANGE_FULL, "709 full" },
+};
+
+static bool start_graphics()
+{
+	if (!obs_startup("en-US", nullptr, nullptr))
+		return false;
+
+	struct obs_video_info ovi = {};
+	ovi.graphics_module = GRAPHICS_MODULE;
+	ovi.fps_num = 30;
+	ovi.fps_den = 1;
+	ovi.base_width = 64;
+	ovi.base_height = 64;
+	ovi.output_width = 64;
+	ovi.output_height = 64;
+	ovi.output_format = VIDEO_FORMAT_NV12;
+	ovi.gpu_conversion = true;
+	ovi.colorspace = VIDEO_CS_709;
+	ovi.range = VIDEO_RANGE_PARTIAL;
+	ovi.scale_type = OBS_SCALE_BICUBIC;
+	return obs_reset_video(&ovi) == OBS_VIDEO_SUCCESS;
+}
+
+// Returns the largest difference between the GPU packing and the CPU
+// reference, or -1 if the frame couldn't be packed or read back
+static int check_packing(gs_effect_t* effect, gs_texrender_t* texrender,
+	const uint8_t* frame, uint32_t width, uint32_t height, bool alpha,
+	const struct check_matrix* matrix)
+{
+	const uint32_t rows = alpha ? height + (height / 2) : height;
+	const uint32_t row_size = width * 2;
+
+	struct matrix4 color_matrix;
+	gpu_packing_color_matrix(matrix->colorspace, matrix->range,
+		&color_matrix);
+
+	float color_vecs[3][4];
+	memcpy(color_vecs[0], &color_matrix.x, sizeof(color_vecs[0]));
+	memcpy(color_vecs[1], &color_matrix.y, sizeof(color_vecs[1]));
+	memcpy(color_vecs[2], &color_matrix.z, sizeof(color_vecs[2]));
+
+	uint8_t* reference = (uint8_t*)bmalloc((size_t)row_size * rows);
+	pack_bgra_to_uyvy_ref(frame, width * 4, width, height, color_vecs,
+		alpha, reference, row_size);
+
+	gs_texture_t* texture = gs_texture_create(width, height, GS_BGRA, 1,
+		&frame, 0);
+	gs_stagesurf_t* surface =
+		gs_stagesurface_create(width / 2, rows, GS_RGBA);
+
+	int max_difference = -1;
+	gs_texture_t* packed = texture ? gpu_packing_render(effect, texrender,
+		texture, alpha, width, height, rows, &color_matrix) : nullptr;
+	if (packed && surface) {
+		gs_stage_texture(surface, packed);
+
+		uint8_t* data;
+		uint32_t linesize;
+		if (gs_stagesurface_map(surface, &data, &linesize)) {
+			max_difference = 0;
+			for (uint32_t y = 0; y < rows; ++y) {
+				const uint8_t* gpu = data + ((size_t)y * linesize);
+				const uint8_t* cpu = reference + ((size_t)y * row_size);
+				for (uint32_t x = 0; x < row_size; ++x) {
+					int difference = abs((int)gpu[x] - (int)cpu[x]);
+					if (difference > max_difference)
+						max_difference = difference;
+				}
+			}
+			gs_stagesurface_unmap(surface);
+		}
+	}
+
+	gs_stagesurface_destroy(surface);
+	gs_texture_destroy(texture);
+	bfree(reference);
+	return max_difference;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <path to ndi-convert.effect>\n",
+			argv[0]);
+		return 1;
+	}
+
+	if (!start_graphics()) {
+		fprintf(stderr, "can't start libobs with %s\n", GRAPHICS_MODULE);
+		obs_shutdown();
+		return 1;
+	}
+
+	int failures = 0;
+	obs_enter_graphics();
+
+	gs_effect_t* effect = gs_effect_create_from_file(argv[1], nullptr);
+	gs_texrender_t* texrender = gs_texrender_create(GS_RGBA, GS_ZS_NONE);
+	if (!effect) {
+		fprintf(stderr, "can't load %s\n", argv[1]);
+		failures++;
+	}
+
+	srand(1);
+	for (size_t i = 0; effect && i < sizeof(check_sizes) /
+		sizeof(check_sizes[0]); ++i)
+	{
+		const uint32_t width = check_sizes[i].width;
+		const uint32_t height = check_sizes[i].height;
+
+		uint8_t* frame = (uint8_t*)bmalloc((size_t)width * height * 4);
+		for (size_t j = 0; j < (size_t)width * height * 4; ++j)
+			frame[j] = (uint8_t)rand();
+
+		for (size_t j = 0; j < sizeof(check_matrices) /
+			sizeof(check_matrices[0]); ++j)
+		{
+			for (int alpha = 0; alpha < 2; ++alpha) {
+				// Same size constraints as the filter's
+				if (alpha && ((width % 4) != 0 || (height % 2) != 0))
+					continue;
+
+				int difference = check_packing(effect, texrender,
+					frame, width, height, alpha != 0,
+					&check_matrices[j]);
+				bool passed = difference >= 0 &&
+					difference <= MAX_DIFFERENCE;
+				if (!passed)
+					failures++;
+
+				printf("%s %ux%u %s: %s (max difference %d)\n",
+					alpha ? "UYVA" : "UYVY", width, height,
+					check_matrices[j].name,
+					passed ? "ok" : "FAILED", difference);
+			}
+		}
+
+		bfree(frame);
+	}
+
+	gs_texrender_destroy(texrender);
+	gs_effect_destroy(effect);
+	obs_leave_graphics();
+	obs_shutdown();
+
+	printf("%d failure(s)\n", failures);
+	return failures ? 1 : 0;
+}
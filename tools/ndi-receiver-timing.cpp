@@ -0,0 +1,197 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+// Measures how long the shared receivers take to deliver the first frame
+// after connecting to an NDI source, and to tear down afterwards, over a
+// number of runs. Each run starts from a fresh registry, so the receiver
+// is created from scratch, as when a source is first added to a scene.
+//
+// Usage: ndi-receiver-timing <NDI source name> [runs]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <QDir>
+#include <QFileInfo>
+#include <QLibrary>
+
+#include <util/base.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#include "obs-ndi.h"
+#include "ndi-receiver.h"
+
+#define FIRST_FRAME_TIMEOUT_MS 10000
+#define DEFAULT_RUNS 10
+
+const NDIlib_v3* ndiLib = nullptr;
+
+typedef const NDIlib_v3* (*NDIlib_v3_load_)(void);
+
+struct timing_run
+{
+	uint64_t connect_ts;
+	volatile long first_video_us;
+	volatile long first_audio_us;
+	os_event_t* first_video_event;
+};
+
+static void on_video(void* param, NDIlib_video_frame_v2_t* frame,
+	uint64_t local_ts)
+{
+	UNUSED_PARAMETER(frame);
+	auto run = (struct timing_run*)param;
+	if (os_atomic_compare_swap_long(&run->first_video_us, 0,
+		(long)((local_ts - run->connect_ts) / 1000)))
+	{
+		os_event_signal(run->first_video_event);
+	}
+}
+
+static void on_audio(void* param, NDIlib_audio_frame_v2_t* frame,
+	uint64_t local_ts)
+{
+	UNUSED_PARAMETER(frame);
+	auto run = (struct timing_run*)param;
+	os_atomic_compare_swap_long(&run->first_audio_us, 0,
+		(long)((local_ts - run->connect_ts) / 1000));
+}
+
+static const NDIlib_v3* load_ndilib()
+{
+	QStringList locations;
+	locations << QString(qgetenv(NDILIB_REDIST_FOLDER));
+#if defined(__linux__) || defined(__APPLE__)
+	locations << "/usr/lib";
+	locations << "/usr/local/lib";
+#endif
+
+	for (QString path : locations) {
+		QFileInfo libPath(QDir(path).absoluteFilePath(NDILIB_LIBRARY_NAME));
+		if (!libPath.exists() || !libPath.isFile())
+			continue;
+
+		auto lib = new QLibrary(libPath.absoluteFilePath(), nullptr);
+		if (lib->load()) {
+			auto lib_load =
+				(NDIlib_v3_load_)lib->resolve("NDIlib_v3_load");
+			if (lib_load)
+				return lib_load();
+		}
+		delete lib;
+	}
+
+	return nullptr;
+}
+
+static int compare_doubles(const void* a, const void* b)
+{
+	double x = *(const double*)a, y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+static void print_summary(const char* label, double* values, int count)
+{
+	if (count == 0) {
+		printf("%-24s no samples\n", label);
+		return;
+	}
+
+	qsort(values, count, sizeof(double), compare_doubles);
+	printf("%-24s min %8.1f ms  median %8.1f ms  max %8.1f ms\n", label,
+		values[0], values[count / 2], values[count - 1]);
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <NDI source name> [runs]\n", argv[0]);
+		return 2;
+	}
+
+	const char* source_name = argv[1];
+	int runs = (argc > 2) ? atoi(argv[2]) : DEFAULT_RUNS;
+	if (runs < 1)
+		runs = 1;
+
+	ndiLib = load_ndilib();
+	if (!ndiLib || !ndiLib->NDIlib_initialize()) {
+		fprintf(stderr, "can't load the NDI runtime\n");
+		return 1;
+	}
+
+	double* first_video = (double*)calloc(runs, sizeof(double));
+	double* first_audio = (double*)calloc(runs, sizeof(double));
+	double* teardown = (double*)calloc(runs, sizeof(double));
+	int video_count = 0, audio_count = 0;
+
+	NDIlib_tally_t tally;
+	tally.on_program = true;
+	tally.on_preview = false;
+
+	for (int i = 0; i < runs; ++i) {
+		struct timing_run run = {};
+		os_event_init(&run.first_video_event, OS_EVENT_TYPE_MANUAL);
+
+		ndi_receiver_registry_init();
+		struct ndi_receiver_subscriber* sub =
+			ndi_receiver_subscriber_create(&run, on_video, on_audio);
+		ndi_receiver_set_tally(sub, &tally);
+
+		struct ndi_receiver_config config = {};
+		config.ndi_name = source_name;
+		config.bandwidth = NDIlib_recv_bandwidth_highest;
+
+		run.connect_ts = os_gettime_ns();
+		ndi_receiver_connect(sub, &config);
+
+		bool received = os_event_timedwait(run.first_video_event,
+			FIRST_FRAME_TIMEOUT_MS) == 0;
+
+		// Teardown as seen by a source being removed, plus the receiver
+		// threads being stopped and joined in the background
+		uint64_t teardown_start = os_gettime_ns();
+		ndi_receiver_subscriber_destroy(sub);
+		ndi_receiver_registry_deinit();
+		teardown[i] = (double)(os_gettime_ns() - teardown_start) / 1000000.0;
+
+		long video_us = os_atomic_load_long(&run.first_video_us);
+		long audio_us = os_atomic_load_long(&run.first_audio_us);
+		if (received)
+			first_video[video_count++] = video_us / 1000.0;
+		if (audio_us)
+			first_audio[audio_count++] = audio_us / 1000.0;
+
+		printf("run %d: first video %s%.1f ms, first audio %.1f ms, "
+			"teardown %.1f ms\n", i + 1, received ? "" : "timed out, ",
+			video_us / 1000.0, audio_us / 1000.0, teardown[i]);
+
+		os_event_destroy(run.first_video_event);
+	}
+
+	printf("\n");
+	print_summary("connect to first video", first_video, video_count);
+	print_summary("connect to first audio", first_audio, audio_count);
+	print_summary("teardown", teardown, runs);
+
+	free(first_video);
+	free(first_audio);
+	free(teardown);
+	ndiLib->NDIlib_destroy();
+	return video_count == runs ? 0 : 1;
+}
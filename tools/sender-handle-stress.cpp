@@ -0,0 +1,159 @@
+/*
+obs-ndi
+Copyright (C) 2016-2018 Stéphane Lepin <steph  name of author
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; If not, see <https://www.gnu.org/licenses/>
+*/
+
+// Stresses the sender slot: reader threads acquire and release the
+// published sender in a tight loop while the main thread keeps replacing
+// it, as settings updates do under a running filter. The NDI runtime is
+// replaced by a table of fakes that check no sender is destroyed while a
+// reader holds it, nor used once destroyed.
+//
+// Usage: sender-handle-stress [readers] [replaces]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <util/base.h>
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#include "obs-ndi.h"
+#include "sender-handle.h"
+
+#define DEFAULT_READERS 8
+#define DEFAULT_REPLACES 20000
+#define MAX_READERS 64
+
+const NDIlib_v3* ndiLib = nullptr;
+
+struct fake_sender
+{
+	volatile long destroyed;
+	volatile long users;
+};
+
+static struct {
+	struct ndi_sender_slot slot;
+	volatile long stop;
+	volatile long violations;
+	volatile long acquired;
+	volatile long empty;
+} stress;
+
+static void fake_send_destroy(NDIlib_send_instance_t instance)
+{
+	auto sender = (struct fake_sender*)instance;
+	if (os_atomic_load_long(&sender->users) != 0)
+		os_atomic_inc_long(&stress.violations);
+	os_atomic_set_long(&sender->destroyed, 1);
+}
+
+static void fake_send_video_async(NDIlib_send_instance_t instance,
+	const NDIlib_video_frame_v2_t* frame)
+{
+	UNUSED_PARAMETER(frame);
+	auto sender = (struct fake_sender*)instance;
+	if (os_atomic_load_long(&sender->destroyed))
+		os_atomic_inc_long(&stress.violations);
+}
+
+static void* reader_thread(void* data)
+{
+	UNUSED_PARAMETER(data);
+
+	while (!os_atomic_load_long(&stress.stop)) {
+		struct ndi_sender_handle* handle =
+			ndi_sender_acquire(&stress.slot);
+		if (!handle) {
+			os_atomic_inc_long(&stress.empty);
+			continue;
+		}
+
+		auto sender = (struct fake_sender*)handle->sender;
+		os_atomic_inc_long(&sender->users);
+		if (os_atomic_load_long(&sender->destroyed))
+			os_atomic_inc_long(&stress.violations);
+		os_atomic_dec_long(&sender->users);
+
+		ndi_sender_handle_release(handle);
+		os_atomic_inc_long(&stress.acquired);
+	}
+
+	return NULL;
+}
+
+int main(int argc, char** argv)
+{
+	int readers = (argc > 1) ? atoi(argv[1]) : DEFAULT_READERS;
+	int replaces = (argc > 2) ? atoi(argv[2]) : DEFAULT_REPLACES;
+	if (readers < 1 || readers > MAX_READERS || replaces < 1) {
+		fprintf(stderr, "usage: %s [readers (1-%d)] [replaces]\n",
+			argv[0], MAX_READERS);
+		return 1;
+	}
+
+	static NDIlib_v3 fake_lib = {};
+	fake_lib.NDIlib_send_destroy = fake_send_destroy;
+	fake_lib.NDIlib_send_send_video_async_v2 = fake_send_video_async;
+	ndiLib = &fake_lib;
+
+	// Destroyed senders are kept to catch late uses
+	auto senders = (struct fake_sender*)bzalloc(
+		sizeof(struct fake_sender) * replaces);
+
+	pthread_t threads[MAX_READERS];
+	for (int i = 0; i < readers; ++i)
+		pthread_create(&threads[i], NULL, reader_thread, NULL);
+
+	uint64_t max_ns = 0;
+	uint64_t total_ns = 0;
+	for (int i = 0; i < replaces; ++i) {
+		// Every few replaces publish no sender, like a failed create
+		NDIlib_send_instance_t sender = (i % 16 == 15) ?
+			nullptr : (NDIlib_send_instance_t)&senders[i];
+
+		uint64_t start = os_gettime_ns();
+		ndi_sender_replace(&stress.slot, sender, true);
+		uint64_t elapsed = os_gettime_ns() - start;
+
+		total_ns += elapsed;
+		if (elapsed > max_ns)
+			max_ns = elapsed;
+	}
+
+	os_atomic_set_long(&stress.stop, 1);
+	for (int i = 0; i < readers; ++i)
+		pthread_join(threads[i], NULL);
+
+	ndi_sender_slot_free(&stress.slot);
+
+	for (int i = 0; i < replaces; ++i) {
+		if ((i % 16 != 15) && !os_atomic_load_long(&senders[i].destroyed))
+			os_atomic_inc_long(&stress.violations);
+	}
+	bfree(senders);
+
+	printf("%d readers, %d replaces: %ld acquires, %ld empty\n"
+		"replace: avg %.1f us, max %.1f us\n"
+		"%ld violations\n",
+		readers, replaces, stress.acquired, stress.empty,
+		(double)total_ns / replaces / 1000.0, (double)max_ns / 1000.0,
+		stress.violations);
+
+	return stress.violations ? 1 : 0;
+}